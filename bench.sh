@@ -0,0 +1,57 @@
+#! /bin/sh
+#
+# Measures how many files a second 'tfc' summarises and replaces over a tree
+# of small files, reading each file with read(2) and loading the files
+# through io_uring (-U). The tree is created once and reused. Each figure is
+# the best of three runs, after a run to bring the tree into the page cache,
+# so the figures are for files already in memory, where the system calls
+# per file matter most. The files already have Unix newlines, so replacing
+# them with -u only reads and compares them.
+#
+#    ./bench.sh [tfc] [files] [directory]
+#
+# The defaults are src/tfc, 100000 files and /tmp/tfc-bench.
+
+TFC=${1:-src/tfc}
+FILES=${2:-100000}
+DIR=${3:-/tmp/tfc-bench}
+
+if [ ! -f "$DIR/.files-$FILES" ]; then
+    rm -rf "$DIR"
+    i=0
+    while [ $i -lt 100 ]; do
+        mkdir -p "$(printf '%s/d%02d' "$DIR" $i)"
+        i=$((i + 1))
+    done
+
+    awk -v files="$FILES" -v dir="$DIR" 'BEGIN {
+        srand(1)
+        for (i = 0; i < files; i++) {
+            file = sprintf("%s/d%02d/f%06d.txt", dir, i % 100, i)
+            lines = 1 + int(rand() * 80)
+            for (l = 0; l < lines; l++)
+                printf "%s%s\n", (rand() < 0.5 ? "\t" : "    "), "some text on a line of the file" > file
+            close(file)
+        }
+    }'
+    touch "$DIR/.files-$FILES"
+fi
+
+run() {
+    "$TFC" "$@" > /dev/null
+    best=0
+    for pass in 1 2 3; do
+        start=$(date +%s%N)
+        "$TFC" "$@" > /dev/null
+        end=$(date +%s%N)
+        rate=$((FILES * 1000000000 / (end - start)))
+        [ $rate -gt $best ] && best=$rate
+    done
+    echo "$best"
+}
+
+echo "$FILES files in $DIR"
+echo "summary  read(2):  $(run -i "$DIR") files/s"
+echo "summary  io_uring: $(run -i "$DIR" -U) files/s"
+echo "replace  read(2):  $(run -r "$DIR" -u) files/s"
+echo "replace  io_uring: $(run -r "$DIR" -u -U) files/s"
@@ -0,0 +1,215 @@
+/**
+ * @file    batch.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the processing of many files in a single run.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+
+
+/**
+ * @section Batch processing implementation.
+ *
+ */
+
+/**
+ * @param  stream - output stream for the reports.
+ * @param  threads - number of worker threads.
+ * @param  task - function that processes a file, writing its report to the
+ *                stream given and returning an error value or 0.
+ * @param  uring - load the files through io_uring, if available.
+ * @param  uncached - load the files without filling the page cache.
+ */
+Batch::Batch(std::ostream &stream, size_t threads, Job task, bool uring, bool uncached) :
+    os{stream}, job{task}, limit{std::max(threads, size_t{1}) * 16},
+    reports{}, mutex{}, progress{}, files{}, ret{}, pool{threads}, loader{}
+{
+    if (uring)
+        loader = std::make_unique<Loader>(pool, limit, uncached);
+
+    if ((loader) && (!loader->is_open()))
+        loader.reset();
+}
+
+/**
+ * Add a file, or every file in a directory and its subdirectories.
+ *
+ * @param  path - of the file or directory.
+ */
+void Batch::add(const std::filesystem::path & path)
+{
+    std::error_code ec{};
+    if (std::filesystem::is_directory(path, ec))
+        walk(path);
+    else
+        submit(path);
+}
+
+/**
+ * Add every file or directory named in a list. Each name is added as soon
+ * as it is read, so processing overlaps reading and the list is never held
+ * in memory; reading pauses while too many files are in flight.
+ *
+ * @param  list - path of the list, or - for standard input.
+ * @param  separator - character that ends each name.
+ */
+void Batch::addList(const std::filesystem::path & list, char separator)
+{
+    std::ifstream file{};
+    if (list != "-")
+    {
+        file.open(list);
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to open file list " << list << '\n';
+            ret = 1;
+
+            return;
+        }
+    }
+
+    std::istream &is{file.is_open() ? file : std::cin};
+    for (std::string name{}; std::getline(is, name, separator); )
+    {
+        if (!name.empty())
+            add(name);
+    }
+}
+
+/**
+ * Add the files of a directory in name order, then its subdirectories.
+ * Hidden files and directories, such as version control metadata, and
+ * symbolic links are skipped, so no file is queued twice through a link.
+ *
+ * @param  directory - to walk.
+ */
+void Batch::walk(const std::filesystem::path & directory)
+{
+    std::error_code ec{};
+    std::vector<std::filesystem::path> entries{};
+    for (std::filesystem::directory_iterator it{directory, ec}, end{}; (!ec) && (it != end); it.increment(ec))
+    {
+        const auto & entry{*it};
+        if (entry.path().filename().string().starts_with('.'))
+            continue;
+
+        entries.push_back(entry.path());
+    }
+
+    if (ec)
+    {
+        std::cerr << "Unable to read directory " << directory << '\n';
+        ret = 1;
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    std::vector<std::filesystem::path> directories{};
+    for (const auto & entry : entries)
+    {
+        if (std::filesystem::is_symlink(entry, ec))
+            continue;
+
+        if (std::filesystem::is_directory(entry, ec))
+            directories.push_back(entry);
+        else
+        if (std::filesystem::is_regular_file(entry, ec))
+            submit(entry);
+    }
+
+    for (const auto & subdirectory : directories)
+        walk(subdirectory);
+}
+
+/**
+ * Queue a file for processing, first waiting for room if too many files
+ * are already in flight.
+ *
+ * @param  file - to process.
+ */
+void Batch::submit(const std::filesystem::path & file)
+{
+    Report *report{};
+    {
+        std::unique_lock lock{mutex};
+        progress.wait(lock, [&]() { return (reports.size() < limit) || (reports.front().done); });
+        drain();
+
+        report = &reports.emplace_back();
+        ++files;
+    }
+
+    auto task = [this, report, file](Loader::Contents contents)
+    {
+        const int status{job(file, contents, report->text)};
+
+        std::lock_guard lock{mutex};
+        report->ret = status;
+        report->done = true;
+        progress.notify_one();
+    };
+
+    if (loader)
+        loader->load(file, task);
+    else
+        pool.submit([task]() { task({}); });
+}
+
+/**
+ * Write the reports of the files that have finished, stopping at the first
+ * that has not. Called with the mutex held.
+ */
+void Batch::drain(void)
+{
+    while ((!reports.empty()) && (reports.front().done))
+    {
+        const auto & report{reports.front()};
+        os << report.text.view();
+        if (report.ret)
+            ret = report.ret;
+
+        reports.pop_front();
+    }
+}
+
+/**
+ * Wait for every file to be processed and write the remaining reports.
+ *
+ * @return error value or 0 if no errors.
+ */
+int Batch::finish(void)
+{
+    std::unique_lock lock{mutex};
+    while (!reports.empty())
+    {
+        progress.wait(lock, [&]() { return reports.front().done; });
+        drain();
+    }
+
+    return ret;
+}
+
@@ -0,0 +1,99 @@
+/**
+ * @file    batch.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the processing of many files in a single run.
+ */
+
+#if !defined _BATCH_H_INCLUDED_
+#define _BATCH_H_INCLUDED_
+
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include "parallel.h"
+#include "loader.h"
+
+
+/**
+ * @section Batch processing.
+ *
+ * Directories are walked recursively, skipping hidden entries, and each
+ * file found becomes a task on a work stealing pool. Names may also be read
+ * from a list, which is read only as fast as the files are processed. The
+ * report for each file is collected in memory and written in the order the
+ * files were added. Only a limited number of files are in flight at once,
+ * so memory use does not grow with the number of files. More files may be
+ * added after finish(), reusing the same pool. Optionally the files are
+ * loaded through io_uring first, and each task is given the contents of
+ * its file if they were loaded. Loading can bypass the page cache.
+ */
+
+class Batch
+{
+public:
+    using Job = std::function<int(const std::filesystem::path &, Loader::Contents, std::ostream &)>;
+
+    Batch(std::ostream &stream, size_t threads, Job task, bool uring = false, bool uncached = false);
+    ~Batch(void) { finish(); }
+
+//- Delete the copy constructor and assignement operator.
+    Batch(const Batch &) = delete;
+    void operator=(const Batch &) = delete;
+
+    void add(const std::filesystem::path & path);
+    void addList(const std::filesystem::path & list, char separator);
+    int finish(void);
+
+    size_t getFiles(void) const { return files; }
+
+private:
+    struct Report
+    {
+        std::ostringstream text;
+        int ret{};
+        bool done{};
+    };
+
+    std::ostream &os;
+    Job job;
+    size_t limit;
+    std::deque<Report> reports;
+    std::mutex mutex;
+    std::condition_variable progress;
+    size_t files;
+    int ret;
+    tfc::WorkPool pool;
+    std::unique_ptr<Loader> loader;
+
+    void walk(const std::filesystem::path & directory);
+    void submit(const std::filesystem::path & file);
+    void drain(void);
+};
+
+
+#endif //!defined _BATCH_H_INCLUDED_
+
@@ -0,0 +1,669 @@
+/**
+ * @file    cache.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the persistent caches of file summaries.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "replace.h"
+
+
+/**
+ * @section Internal constants and variables.
+ *
+ */
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+static constexpr uint32_t version{1};
+static constexpr uint32_t empty{UINT32_MAX};
+
+//- Files changed this recently may change again without their modification
+//- time moving on, so their results are not kept.
+static constexpr uint64_t racyPeriod{2'000'000'000};
+
+static bool isValid(const Header &header, uint32_t recordSize)
+{
+    return (std::memcmp(header.magic, "tfccache", sizeof header.magic) == 0) &&
+        (header.version == version) && (header.recordSize == recordSize);
+}
+
+static uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+
+    return value;
+}
+
+/**
+ * @return a hash of the fields that identify the file, so that a newer
+ * record for the same file supersedes an older one.
+ */
+static uint64_t hashOf(const Cache::Key &key)
+{
+    return mix(key.device ^ mix(key.inode ^ mix(key.options)));
+}
+
+static bool isSameFile(const Cache::Key &a, const Cache::Key &b)
+{
+    return (a.device == b.device) && (a.inode == b.inode) && (a.options == b.options);
+}
+
+/**
+ * @return a checksum of a record, excluding the checksum itself.
+ */
+template<typename T>
+static uint64_t checksum(const T &record)
+{
+    const auto *bytes{reinterpret_cast<const unsigned char *>(&record)};
+    uint64_t hash{0xCBF29CE484222325ull};
+    for (size_t i{}; i < offsetof(T, check); ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+
+    return hash;
+}
+
+
+/**
+ * @section Persistent result cache implementation.
+ *
+ */
+
+/**
+ * Map and index the cache file, if there is one.
+ *
+ * @param  file - path of the cache file.
+ */
+Cache::Cache(const std::filesystem::path & file) :
+    path{file}, records{}, count{}, mapSize{}, map{}, index{},
+    superseded{}, damaged{}, pending{}, mutex{}
+{
+    static_assert(sizeof(Record) == 88, "cache records must not contain padding");
+    static_assert(sizeof(Header) % alignof(Record) == 0, "cache records must be aligned");
+
+    load();
+}
+
+Cache::~Cache(void)
+{
+    if (map)
+        ::munmap(map, mapSize);
+}
+
+/**
+ * Map the cache file and index every valid record. Reading stops at the
+ * first record that fails its checksum, which can only be the result of an
+ * interrupted append, and the cache is marked for rewriting.
+ */
+void Cache::load(void)
+{
+    const int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0)
+        return;
+
+    struct stat info{};
+    if ((::fstat(fd, &info) == 0) && (static_cast<size_t>(info.st_size) >= sizeof(Header)))
+    {
+        mapSize = info.st_size;
+        map = ::mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            map = nullptr;
+    }
+    ::close(fd);
+
+    if ((!map) || (!isValid(*static_cast<const Header *>(map), sizeof(Record))))
+    {
+        damaged = true;
+
+        return;
+    }
+
+    records = reinterpret_cast<const Record *>(static_cast<const char *>(map) + sizeof(Header));
+    count = (mapSize - sizeof(Header)) / sizeof(Record);
+    damaged = (count * sizeof(Record) + sizeof(Header) != mapSize);
+
+    size_t slots{16};
+    while (slots < count * 2)
+        slots *= 2;
+
+    index.assign(slots, empty);
+    for (size_t i{}; i < count; ++i)
+    {
+        if (checksum(records[i]) != records[i].check)
+        {
+            count = i;
+            damaged = true;
+
+            break;
+        }
+
+        add(i);
+    }
+}
+
+/**
+ * Index a record, replacing any older record for the same file.
+ *
+ * @param  record - position of the record in the file.
+ */
+void Cache::add(uint32_t record)
+{
+    const size_t mask{index.size() - 1};
+    for (size_t slot{hashOf(records[record].key) & mask}; ; slot = (slot + 1) & mask)
+    {
+        if (index[slot] == empty)
+        {
+            index[slot] = record;
+
+            return;
+        }
+
+        if (isSameFile(records[index[slot]].key, records[record].key))
+        {
+            index[slot] = record;
+            ++superseded;
+
+            return;
+        }
+    }
+}
+
+/**
+ * Identify a file by its status. Only regular files can be cached.
+ *
+ * @param  file - path of the file.
+ * @param  options - hash of the options that affect the results.
+ * @param  key - updated with the key of the file.
+ * @return true if the file can be cached.
+ */
+bool Cache::makeKey(const std::filesystem::path & file, uint64_t options, Key &key)
+{
+    struct stat info{};
+    if ((::stat(file.c_str(), &info) != 0) || (!S_ISREG(info.st_mode)))
+        return false;
+
+    key.device = info.st_dev;
+    key.inode = info.st_ino;
+    key.size = info.st_size;
+    key.modified = uint64_t(info.st_mtim.tv_sec) * 1'000'000'000 + info.st_mtim.tv_nsec;
+    key.options = options;
+
+    return true;
+}
+
+/**
+ * Find the latest record for the same file and options as a key.
+ *
+ * @param  key - the key of the file.
+ * @return the position of the record, or empty if there is none.
+ */
+uint32_t Cache::lookup(const Key &key) const
+{
+    if (index.empty())
+        return empty;
+
+    const size_t mask{index.size() - 1};
+    for (size_t slot{hashOf(key) & mask}; index[slot] != empty; slot = (slot + 1) & mask)
+        if (isSameFile(records[index[slot]].key, key))
+            return index[slot];
+
+    return empty;
+}
+
+/**
+ * Look for the counts of a file that has not changed since it was cached.
+ *
+ * @param  key - the key of the file.
+ * @param  counts - updated with the cached counts.
+ * @return true if the file was found unchanged.
+ */
+bool Cache::find(const Key &key, Counts &counts) const
+{
+    const uint32_t found{lookup(key)};
+    if (found == empty)
+        return false;
+
+    const Record &record{records[found]};
+    if ((record.key.size != key.size) || (record.key.modified != key.modified))
+        return false;
+
+    counts = record.counts;
+
+    return true;
+}
+
+/**
+ * Keep the counts of a file to be written when the cache is flushed. Files
+ * modified too recently to be sure of are left out, judged by the clock
+ * now, since a cache may be kept for a long time, as when watching.
+ *
+ * @param  key - the key of the file.
+ * @param  counts - the counts found for the file.
+ */
+void Cache::insert(const Key &key, const Counts &counts)
+{
+    const auto now{std::chrono::system_clock::now().time_since_epoch()};
+    const uint64_t recent{std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - racyPeriod};
+    if (key.modified >= recent)
+        return;
+
+    Record record{key, counts, 0};
+    record.check = checksum(record);
+
+    std::lock_guard lock{mutex};
+    pending.push_back(record);
+}
+
+/**
+ * Write the new records to the cache file, rewriting it instead when it is
+ * missing or damaged or when most of its records are out of date. Failing
+ * to update the cache does not affect the results, so it is only reported.
+ */
+void Cache::flush(void)
+{
+    std::lock_guard lock{mutex};
+    const bool rebuild{(!records) || (damaged) || (superseded * 2 > count)};
+    if ((pending.empty()) && ((!rebuild) || (!map)))
+        return;
+
+    if (!(rebuild ? rewrite() : append()))
+        std::cerr << "Unable to update cache file " << path << '\n';
+
+    pending.clear();
+    reload();
+}
+
+/**
+ * Forget the mapping and load the cache file again, for a cache that is
+ * flushed more than once.
+ */
+void Cache::reload(void)
+{
+    if (map)
+        ::munmap(map, mapSize);
+
+    records = nullptr;
+    count = 0;
+    mapSize = 0;
+    map = nullptr;
+    index.clear();
+    superseded = 0;
+    damaged = false;
+
+    load();
+}
+
+/**
+ * Append the new records with a single write, which concurrent writers
+ * cannot interleave with their own.
+ *
+ * @return true if the records were written.
+ */
+bool Cache::append(void)
+{
+    const int fd{::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC)};
+    if (fd < 0)
+        return rewrite();
+
+    const char *first{reinterpret_cast<const char *>(pending.data())};
+    size_t length{pending.size() * sizeof(Record)};
+    while (length)
+    {
+        const ssize_t written{::write(fd, first, length)};
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        first += written;
+        length -= written;
+    }
+
+    return (::close(fd) == 0) && (length == 0);
+}
+
+/**
+ * Write the latest record for each file to a new cache file and rename it
+ * over the old one.
+ *
+ * @return true if the cache file was replaced.
+ */
+bool Cache::rewrite(void)
+{
+    std::vector<bool> replaced(count);
+    for (const auto & record : pending)
+    {
+        const uint32_t found{lookup(record.key)};
+        if (found != empty)
+            replaced[found] = true;
+    }
+
+    std::vector<Record> latest{};
+    latest.reserve(count - superseded + pending.size());
+    for (const auto slot : index)
+        if ((slot != empty) && (!replaced[slot]))
+            latest.push_back(records[slot]);
+
+    latest.insert(latest.end(), pending.begin(), pending.end());
+
+    Header header{};
+    std::memcpy(header.magic, "tfccache", sizeof header.magic);
+    header.version = version;
+    header.recordSize = sizeof(Record);
+
+    Replacement replacement{path};
+
+    return (replacement.is_open()) &&
+        (replacement.write(reinterpret_cast<const char *>(&header), sizeof header)) &&
+        (replacement.write(reinterpret_cast<const char *>(latest.data()), latest.size() * sizeof(Record))) &&
+        (replacement.commit(false) == 0);
+}
+
+
+
+/**
+ * @section Content hash.
+ *
+ * XXH64: the data is consumed 32 bytes at a time by four independent
+ * accumulators, so the multiplies of consecutive words overlap and the hash
+ * runs at close to memory bandwidth without needing vector instructions.
+ */
+
+static constexpr uint64_t prime1{0x9E3779B185EBCA87ull};
+static constexpr uint64_t prime2{0xC2B2AE3D27D4EB4Full};
+static constexpr uint64_t prime3{0x165667B19E3779F9ull};
+static constexpr uint64_t prime4{0x85EBCA77C2B2AE63ull};
+static constexpr uint64_t prime5{0x27D4EB2F165667C5ull};
+
+static uint64_t rotate(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t load64(const char *p)
+{
+    uint64_t value;
+    std::memcpy(&value, p, sizeof value);
+
+    return value;
+}
+
+static uint32_t load32(const char *p)
+{
+    uint32_t value;
+    std::memcpy(&value, p, sizeof value);
+
+    return value;
+}
+
+static uint64_t accumulate(uint64_t accumulator, uint64_t input)
+{
+    return rotate(accumulator + (input * prime2), 31) * prime1;
+}
+
+static uint64_t merge(uint64_t hash, uint64_t accumulator)
+{
+    return ((hash ^ accumulate(0, accumulator)) * prime1) + prime4;
+}
+
+ContentHash::ContentHash(void) :
+    v1{prime1 + prime2}, v2{prime2}, v3{0}, v4{0 - prime1}, length{}, buffered{}, buffer{}
+{
+}
+
+/**
+ * Consume a stripe of 32 bytes.
+ */
+void ContentHash::consume(const char *p)
+{
+    v1 = accumulate(v1, load64(p));
+    v2 = accumulate(v2, load64(p + 8));
+    v3 = accumulate(v3, load64(p + 16));
+    v4 = accumulate(v4, load64(p + 24));
+}
+
+/**
+ * Add the next block of the contents. Whole stripes are consumed straight
+ * from the block, only a partial stripe left over is kept for the next.
+ *
+ * @param  block - the next block of the contents.
+ */
+void ContentHash::update(std::span<const char> block)
+{
+    const char *p{block.data()};
+    const char * const last{p + block.size()};
+    length += block.size();
+
+    if (buffered)
+    {
+        const size_t count{std::min(sizeof buffer - buffered, block.size())};
+        std::memcpy(buffer + buffered, p, count);
+        buffered += count;
+        p += count;
+        if (buffered < sizeof buffer)
+            return;
+
+        consume(buffer);
+        buffered = 0;
+    }
+
+//- The accumulators are kept in locals, as the stores to members could
+//- alias the bytes being loaded.
+    uint64_t a1{v1};
+    uint64_t a2{v2};
+    uint64_t a3{v3};
+    uint64_t a4{v4};
+    for (; last - p >= 32; p += 32)
+    {
+        a1 = accumulate(a1, load64(p));
+        a2 = accumulate(a2, load64(p + 8));
+        a3 = accumulate(a3, load64(p + 16));
+        a4 = accumulate(a4, load64(p + 24));
+    }
+
+    v1 = a1;
+    v2 = a2;
+    v3 = a3;
+    v4 = a4;
+    buffered = last - p;
+    std::memcpy(buffer, p, buffered);
+}
+
+/**
+ * @return the 64 bit hash of the contents so far.
+ */
+uint64_t ContentHash::digest(void) const
+{
+    const char *p{buffer};
+    const char * const last{p + buffered};
+    uint64_t hash{};
+
+    if (length >= 32)
+    {
+        hash = rotate(v1, 1) + rotate(v2, 7) + rotate(v3, 12) + rotate(v4, 18);
+        hash = merge(hash, v1);
+        hash = merge(hash, v2);
+        hash = merge(hash, v3);
+        hash = merge(hash, v4);
+    }
+    else
+    {
+        hash = prime5;
+    }
+
+    hash += length;
+
+    for (; last - p >= 8; p += 8)
+        hash = (rotate(hash ^ accumulate(0, load64(p)), 27) * prime1) + prime4;
+
+    if (last - p >= 4)
+    {
+        hash = (rotate(hash ^ (load32(p) * prime1), 23) * prime2) + prime3;
+        p += 4;
+    }
+
+    for (; p != last; ++p)
+        hash = rotate(hash ^ (static_cast<unsigned char>(*p) * prime5), 11) * prime1;
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/**
+ * @param  data - the contents to hash.
+ * @return the 64 bit hash of the contents.
+ */
+uint64_t hashContents(std::span<const char> data)
+{
+    ContentHash hash{};
+    hash.update(data);
+
+    return hash.digest();
+}
+
+
+/**
+ * @section Content addressed cache implementation.
+ *
+ */
+
+/**
+ * @return the path of the entry for the given contents and options, spread
+ * over subdirectories named after the first byte of the hash.
+ */
+std::filesystem::path ContentCache::entryPath(uint64_t hash, size_t size, uint64_t options) const
+{
+    char name[64];
+    std::snprintf(name, sizeof name, "%016llx-%llx-%llx",
+        static_cast<unsigned long long>(hash), static_cast<unsigned long long>(size),
+        static_cast<unsigned long long>(options));
+
+    return directory / std::string{name, 2} / std::string{name + 2};
+}
+
+/**
+ * Read an entry of the given kind.
+ *
+ * @param  file - path of the entry.
+ * @param  kind - the kind of entry wanted.
+ * @param  entry - updated with the entry.
+ * @return true if a valid entry was read.
+ */
+bool ContentCache::read(const std::filesystem::path & file, Kind kind, Entry &entry) const
+{
+    const int fd{::open(file.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0)
+        return false;
+
+    const ssize_t length{::read(fd, &entry, sizeof entry)};
+    ::close(fd);
+
+    return (length == sizeof entry) && (std::memcmp(entry.magic, "tfcentry", sizeof entry.magic) == 0) &&
+        (entry.version == version) && (entry.kind == kind);
+}
+
+/**
+ * Write an entry, creating its subdirectory if needed. Failing to write an
+ * entry does not affect the results, so it is only reported.
+ *
+ * @param  file - path of the entry.
+ * @param  kind - the kind of entry.
+ * @param  counts - the counts to keep, if any.
+ */
+void ContentCache::write(const std::filesystem::path & file, Kind kind, const Cache::Counts &counts)
+{
+    Entry entry{};
+    std::memcpy(entry.magic, "tfcentry", sizeof entry.magic);
+    entry.version = version;
+    entry.kind = kind;
+    entry.counts = counts;
+
+    std::error_code ec{};
+    std::filesystem::create_directories(file.parent_path(), ec);
+
+//- An entry is shared by every run, so it does not keep the mode of one it
+//- replaces, which may have been left readable by its owner alone.
+    Replacement replacement{file};
+    if ((!replacement.is_open()) || (!replacement.setMode(Replacement::getCreateMode())) ||
+        (!replacement.write(reinterpret_cast<const char *>(&entry), sizeof entry)) ||
+        (replacement.commit(false) != 0))
+        std::cerr << "Unable to write cache entry " << file << '\n';
+}
+
+bool ContentCache::findCounts(uint64_t hash, size_t size, uint64_t options, Cache::Counts &counts) const
+{
+    Entry entry{};
+    if (!read(entryPath(hash, size, options), summary, entry))
+        return false;
+
+    counts = entry.counts;
+
+    return true;
+}
+
+bool ContentCache::isUnchanged(uint64_t hash, size_t size, uint64_t options) const
+{
+    Entry entry{};
+
+    return read(entryPath(hash, size, options), unchanged, entry);
+}
+
+void ContentCache::insertCounts(uint64_t hash, size_t size, uint64_t options, const Cache::Counts &counts)
+{
+    write(entryPath(hash, size, options), summary, counts);
+}
+
+void ContentCache::insertUnchanged(uint64_t hash, size_t size, uint64_t options)
+{
+    write(entryPath(hash, size, options), unchanged, {});
+}
+
@@ -0,0 +1,181 @@
+/**
+ * @file    cache.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the persistent caches of file summaries.
+ */
+
+#if !defined _CACHE_H_INCLUDED_
+#define _CACHE_H_INCLUDED_
+
+#include <filesystem>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <span>
+
+#include "libtfc.h"
+
+
+/**
+ * @section Persistent result cache.
+ *
+ * The cache file is a short header followed by fixed size records, each
+ * holding the device, inode, size and modification time of a file, a hash
+ * of the options used, the counts found and a checksum. The file is mapped
+ * and indexed when opened, so lookups read the mapping directly and files
+ * whose key matches are not opened at all.
+ *
+ * New records are added with a single append, so concurrent runs can share
+ * a cache without locking. A record that fails its checksum ends the valid
+ * part of the file. When that happens, or when most records have been
+ * superseded by newer ones, the cache is rewritten through a temporary file
+ * that is renamed over it, so readers never see a partial file.
+ */
+
+class Cache
+{
+public:
+    struct Key
+    {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        uint64_t modified;
+        uint64_t options;
+    };
+    using Counts = tfc::Summary;
+
+    explicit Cache(const std::filesystem::path & file);
+    ~Cache(void);
+
+//- Delete the copy constructor and assignement operator.
+    Cache(const Cache &) = delete;
+    void operator=(const Cache &) = delete;
+
+    static bool makeKey(const std::filesystem::path & file, uint64_t options, Key &key);
+
+    bool find(const Key &key, Counts &counts) const;
+    void insert(const Key &key, const Counts &counts);
+    void flush(void);
+
+private:
+    struct Record
+    {
+        Key key;
+        Counts counts;
+        uint64_t check;
+    };
+
+    std::filesystem::path path;
+    const Record *records;
+    size_t count;
+    size_t mapSize;
+    void *map;
+    std::vector<uint32_t> index;
+    size_t superseded;
+    bool damaged;
+    std::vector<Record> pending;
+    std::mutex mutex;
+
+    void load(void);
+    void reload(void);
+    void add(uint32_t record);
+    uint32_t lookup(const Key &key) const;
+    bool append(void);
+    bool rewrite(void);
+};
+
+
+
+/**
+ * @section Content addressed cache.
+ *
+ * Results are kept in a directory, under a name made from a hash of the
+ * contents of the file, its size and a hash of the options used, so they
+ * remain valid after a fresh checkout or on another workspace sharing the
+ * directory. Each entry is a small file that is written to a temporary file
+ * and renamed into place, so concurrent runs never see a partial entry. An
+ * entry holds either the counts of a summary or the verdict that the
+ * transform leaves the file unchanged.
+ */
+
+extern uint64_t hashContents(std::span<const char> data);
+
+/**
+ * The same hash of contents that arrive a block at a time, so that a file
+ * can be hashed by the loop that processes it.
+ */
+class ContentHash
+{
+public:
+    ContentHash(void);
+
+    void update(std::span<const char> block);
+    uint64_t digest(void) const;
+
+private:
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+    uint64_t v4;
+    size_t length;
+    size_t buffered;
+    char buffer[32];
+
+    void consume(const char *p);
+};
+
+class ContentCache
+{
+public:
+    explicit ContentCache(const std::filesystem::path & path) : directory{path} {}
+
+//- Delete the copy constructor and assignement operator.
+    ContentCache(const ContentCache &) = delete;
+    void operator=(const ContentCache &) = delete;
+
+    bool findCounts(uint64_t hash, size_t size, uint64_t options, Cache::Counts &counts) const;
+    bool isUnchanged(uint64_t hash, size_t size, uint64_t options) const;
+
+    void insertCounts(uint64_t hash, size_t size, uint64_t options, const Cache::Counts &counts);
+    void insertUnchanged(uint64_t hash, size_t size, uint64_t options);
+
+private:
+    enum Kind : uint32_t { summary = 1, unchanged = 2 };
+    struct Entry
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t kind;
+        Cache::Counts counts;
+    };
+
+    std::filesystem::path directory;
+
+    std::filesystem::path entryPath(uint64_t hash, size_t size, uint64_t options) const;
+    bool read(const std::filesystem::path & file, Kind kind, Entry &entry) const;
+    void write(const std::filesystem::path & file, Kind kind, const Cache::Counts &counts);
+};
+
+
+#endif //!defined _CACHE_H_INCLUDED_
+
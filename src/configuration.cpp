@@ -23,11 +23,15 @@
  * Implementation of the tfc configuration Singleton.
  */
 
+#include <algorithm>
 #include <future>
 #include <vector>
+#include <thread>
 
 #include "configuration.h"
 #include "Opts.h"
+#include "input.h"
+#include "kernel.h"
 
 
 /**
@@ -55,9 +59,13 @@ const Opts::OptsType optList
     { 'h', "help",    NULL,   "This help page and nothing else." },
     { 'v', "version", NULL,   "Display version." },
     { 0,   NULL,      NULL,   "" },
-    { 'i', "input",   "file", "Input file name." },
+    { 'i', "input",   "file", "Input file, directory or - for stdin (may be repeated)." },
     { 'o', "output",  "file", "Output file name (default: console)." },
-    { 'r', "replace", "file", "Replace file with transformed version." },
+    { 'r', "replace", "file", "Replace file with transformed version (may be repeated)." },
+    { 'f', "files-from", "file", "Read input file names from file, or - for standard input." },
+    { '0', NULL,      NULL,   "File names read are separated by NUL characters." },
+    { 'w', "write",   NULL,   "Replace the input files with transformed versions." },
+    { 'W', "watch",   "dir",  "Watch directory, re-checking files as they change." },
     { 'd', "dos",     NULL,   "DOS style End-Of-line." },
     { 'u', "unix",    NULL,   "Unix style End-Of-line." },
     { 's', "space",   NULL,   "Use leading spaces." },
@@ -65,11 +73,25 @@ const Opts::OptsType optList
     { '2', NULL,      NULL,   "Set tab size to 2 spaces." },
     { '4', NULL,      NULL,   "Set tab size to 4 spaces (default)." },
     { '8', NULL,      NULL,   "Set tab size to 8 spaces." },
+    { 'b', "block",   "KiB",  "Input block size (64 to 4096, default: 256)." },
+    { 'B', "buffers", "N",    "Pipeline blocks in flight (1 to 64, default: 4)." },
+    { 'm', "mmap",    NULL,   "Memory map the input file." },
+    { 'j', "jobs",    "N",    "Number of threads to use (default: 1, or all cores for many files)." },
+    { 'U', "uring",   NULL,   "Load many small files through io_uring." },
+    { 'n', "no-cache", NULL,  "Read files without filling the page cache." },
+    { 'y', "sync",    NULL,   "Sync replaced file to disk before renaming." },
+    { 'c', "cache",   "file", "Cache the summaries of unchanged files in file." },
+    { 'C', "content-cache", "dir", "Cache results by file contents in directory." },
+    { 'D', "daemon",  "socket", "Serve requests from clients on socket." },
+    { 'S', "socket",  "socket", "Send the input file to the daemon on socket." },
     { 'x', NULL,      NULL,   "" },
 
 };
 Opts optSet{optList, "    "};
 
+static constexpr size_t maxJobs{1024};
+static constexpr size_t maxBuffers{64};
+
 /**
  * Display help message.
  *
@@ -128,6 +150,10 @@ int Config::parseCommandLine(int argc, char *argv[])
         case 'i': setInputFile(option.getArg()); break;
         case 'o': setOutputFile(option.getArg()); break;
         case 'r': setReplaceFile(option.getArg()); break;
+        case 'f': setListFile(option.getArg()); break;
+        case '0': enableNulSeparated(); break;
+        case 'w': enableReplace(); break;
+        case 'W': setWatchDirectory(option.getArg()); break;
 
         case 'd': setDos();     break;
         case 'u': setUnix();    break;
@@ -139,6 +165,18 @@ int Config::parseCommandLine(int argc, char *argv[])
         case '4': setTabSize(4);break;
         case '8': setTabSize(8);break;
 
+        case 'b': setBlockSize(option.getArgInt()); break;
+        case 'B': setBuffers(option.getArgInt()); break;
+        case 'm': enableMapping(); break;
+        case 'j': setJobs(option.getArgInt()); break;
+        case 'U': enableUring(); break;
+        case 'n': disableCaching(); break;
+        case 'y': enableSync(); break;
+        case 'c': setCacheFile(option.getArg()); break;
+        case 'C': setCacheDirectory(option.getArg()); break;
+        case 'D': setDaemonSocket(option.getArg()); break;
+        case 'S': setClientSocket(option.getArg()); break;
+
         case 'x': enableDebug();break;
 
         default: return help("internal error.");
@@ -174,11 +212,97 @@ int Config::init(int argc, char *argv[])
  * Support code.
  */
 
+/**
+ * @return the first input file, which is the only one unless in batch mode.
+ */
+const std::filesystem::path & Config::getInputFile(void)
+{
+    static const std::filesystem::path none{};
+    const auto & inputFiles{getInputFiles()};
+
+    return inputFiles.empty() ? none : inputFiles.front();
+}
+
+/**
+ * @return true if more than one file or a directory is to be processed.
+ */
+bool Config::isBatch(void)
+{
+    const auto & inputFiles{getInputFiles()};
+    if ((inputFiles.size() > 1) || (isListing()))
+        return true;
+
+    std::error_code ec{};
+
+    return (!inputFiles.empty()) && (std::filesystem::is_directory(inputFiles.front(), ec));
+}
+
+/**
+ * @return the number of threads requested, otherwise one thread for a single
+ * file and a thread per core for many files or a daemon.
+ */
+size_t Config::getJobs(void)
+{
+    if ((instance().jobsSet) || ((!isBatch()) && (!isServing())))
+        return instance().jobs;
+
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+/**
+ * @return the options that affect the results, to be passed to the engines.
+ */
+Options Config::getOptions(void)
+{
+    Options options{};
+    if (isSpace())
+        options.leading = Leading::space;
+    else if (isTab())
+        options.leading = Leading::tab;
+
+    if (isDos())
+        options.trailing = Trailing::crlf;
+    else if (isUnix())
+        options.trailing = Trailing::lf;
+
+    options.tabSize = getTabSize();
+    options.debug = isDebug();
+
+    return options;
+}
+
+/**
+ * @return the settings for processing each file, to be passed to the
+ * engines. A single file is mapped when it is to be split over many threads,
+ * unless it is to be read without filling the page cache. Many files
+ * already keep the cores busy with a file each, so only a single file is
+ * pipelined.
+ */
+Job Config::getJob(void)
+{
+    Job job{};
+    job.options = getOptions();
+    job.blockSize = getBlockSize();
+    job.mapping = (isMapping()) || ((getJobs() > 1) && (!isBatch()) && (!isUncached()));
+    job.jobs = getJobs();
+    job.buffers = isBatch() ? 1 : getBuffers();
+    job.uring = isUring();
+    job.uncached = isUncached();
+    job.sync = isSyncing();
+
+    return job;
+}
+
 void Config::display(std::ostream &os) const
 {
     os << "Config is " << std::string{isValid() ? "" : "NOT "} << "valid\n";
     os << "Application name: " << getName() << '\n';
-    os << "Input file name:  " << getInputFile() << '\n';
+    for (const auto & inputFile : getInputFiles())
+        os << "Input file name:  " << inputFile << '\n';
+    if (isListing())
+        os << "Input file names from: " << getListFile() << '\n';
+    if (isWatching())
+        os << "Watching for changes.\n";
     os << "Output file name: " << getOutputFile() << '\n';
     if (isLeadingSet())
     {
@@ -203,8 +327,28 @@ void Config::display(std::ostream &os) const
         os << "Newlines will be unchanged\n";
     }
     os << "Tab size: " << getTabSize() << '\n';
+    os << "Block size: " << getBlockSize() / 1024 << " KiB\n";
+    os << "Pipeline blocks: " << getBuffers() << '\n';
+    if (isMapping())
+        os << "Memory mapping input file.\n";
+    os << "Threads: " << getJobs() << '\n';
+    if (isUring())
+        os << "Loading files through io_uring.\n";
+    if (isUncached())
+        os << "Reading files without filling the page cache.\n";
+    os << "Scanning kernel: " << tfc::getKernelName() << '\n';
     if (isReplacing())
         os << "Overwriting source file contents.\n";
+    if (isSyncing())
+        os << "Syncing replaced file to disk.\n";
+    if (isCaching())
+        os << "Cache file name:  " << getCacheFile() << '\n';
+    if (isContentCaching())
+        os << "Cache directory:  " << getCacheDirectory() << '\n';
+    if (isServing())
+        os << "Serving requests on socket: " << getSocket() << '\n';
+    if (isClient())
+        os << "Sending requests to socket: " << getSocket() << '\n';
     if (isDebug())
         os << "Generating debug summary.\n";
 }
@@ -222,7 +366,20 @@ bool Config::isValid(bool showErrors)
 
     const auto & inputFile{getInputFile()};
 
-    if (inputFile.string().empty())
+    if (isServing())
+    {
+        if ((!getInputFiles().empty()) || (isListing()) || (isReplacing()) || (isChangeRequested()))
+        {
+            if (showErrors)
+                std::cerr << "\nThe daemon takes its files and options from its clients.\n";
+
+            return false;
+        }
+
+        return true;
+    }
+
+    if ((inputFile.string().empty()) && (!isListing()))
     {
         if (showErrors)
             std::cerr << "\nInput (or replacement) file must be specified.\n";
@@ -230,40 +387,164 @@ bool Config::isValid(bool showErrors)
         return false;
     }
 
-    if (!fs::exists(inputFile))
+    const auto & listFile{getListFile()};
+    if ((isListing()) && (listFile != "-") && (!fs::exists(listFile)))
+    {
+        if (showErrors)
+        {
+            std::cerr << "\nFile list " << listFile << " does not exist.\n";
+        }
+
+        return false;
+    }
+
+    for (const auto & file : getInputFiles())
+    {
+        if ((file != "-") && (!fs::exists(file)))
+        {
+            if (showErrors)
+            {
+                std::cerr << "\nInput file " << file << " does not exist.\n";
+            }
+
+            return false;
+        }
+    }
+
+    const auto & inputFiles{getInputFiles()};
+    if (std::find(inputFiles.begin(), inputFiles.end(), "-") != inputFiles.end())
+    {
+        if (isReplacing())
+        {
+            if (showErrors)
+                std::cerr << "\nStandard input cannot be replaced.\n";
+
+            return false;
+        }
+
+        if (listFile == "-")
+        {
+            if (showErrors)
+                std::cerr << "\nStandard input cannot be both a file list and an input file.\n";
+
+            return false;
+        }
+    }
+
+    const auto blockSize{getBlockSize()};
+    if ((blockSize < tfc::Input::minBlockSize) || (blockSize > tfc::Input::maxBlockSize))
     {
         if (showErrors)
         {
-            std::cerr << "\nInput file " << inputFile << " does not exist.\n";
+            std::cerr << "\nBlock size must be between " << tfc::Input::minBlockSize / 1024;
+            std::cerr << " and " << tfc::Input::maxBlockSize / 1024 << " KiB.\n";
         }
 
         return false;
     }
 
+    const auto buffers{getBuffers()};
+    if ((buffers < 1) || (buffers > maxBuffers))
+    {
+        if (showErrors)
+            std::cerr << "\nNumber of pipeline blocks must be between 1 and " << maxBuffers << ".\n";
+
+        return false;
+    }
+
+    const auto jobs{getJobs()};
+    if ((jobs < 1) || (jobs > maxJobs))
+    {
+        if (showErrors)
+            std::cerr << "\nNumber of threads must be between 1 and " << maxJobs << ".\n";
+
+        return false;
+    }
+
     if (isReplacing() && isSummary())
     {
         if (showErrors)
         {
-            std::cerr << "\nCannot overwrite input file " << inputFile << " with a summary.\n";
+            if (inputFile.empty())
+                std::cerr << "\nCannot overwrite input files with a summary.\n";
+            else
+                std::cerr << "\nCannot overwrite input file " << inputFile << " with a summary.\n";
         }
 
         return false;
     }
 
-    const auto & outputFile{getOutputFile()};
+    if (isBatch() && isChangeRequested() && !isReplacing())
+    {
+        if (showErrors)
+        {
+            std::cerr << "\nMultiple files can only be transformed using the replace option.\n";
+        }
 
-    if (fs::exists(outputFile))
+        return false;
+    }
+
+    if (isWatching())
     {
-        if (fs::equivalent(inputFile, outputFile))
+        const auto isDirectory = [](const auto & file) { return fs::is_directory(file); };
+        if ((isListing()) || (!std::all_of(inputFiles.begin(), inputFiles.end(), isDirectory)))
         {
             if (showErrors)
             {
-                std::cerr << "\nInput and output files are the same. To replace source file use:\n";
-                std::cerr << "\ttfc -r " << inputFile.string() << " [Options]\n";
+                std::cerr << "\nOnly directories can be watched.\n";
             }
-        
+
             return false;
         }
+    }
+
+    if (isClient() && (isBatch() || isReplacing() || isCaching() || isContentCaching()))
+    {
+        if (showErrors)
+        {
+            std::cerr << "\nOnly a single file can be sent to a daemon.\n";
+        }
+
+        return false;
+    }
+
+    if (isCaching() && isChangeRequested())
+    {
+        if (showErrors)
+        {
+            std::cerr << "\nOnly summaries can be cached.\n";
+        }
+
+        return false;
+    }
+
+    if (isContentCaching() && isChangeRequested() && !isReplacing())
+    {
+        if (showErrors)
+        {
+            std::cerr << "\nOnly summaries and replaced files can be cached by contents.\n";
+        }
+
+        return false;
+    }
+
+    const auto & outputFile{getOutputFile()};
+
+    if (fs::exists(outputFile))
+    {
+        for (const auto & file : getInputFiles())
+        {
+            if ((file != "-") && (fs::equivalent(file, outputFile)))
+            {
+                if (showErrors)
+                {
+                    std::cerr << "\nInput and output files are the same. To replace source file use:\n";
+                    std::cerr << "\ttfc -r " << file.string() << " [Options]\n";
+                }
+
+                return false;
+            }
+        }
 
         if (showErrors)
         {
@@ -28,9 +28,18 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <filesystem>
+#include <cstdint>
 
 #include "config.h"
+#include "options.h"
+
+//- The processing options live in the library's namespace.
+using tfc::Options;
+using tfc::Leading;
+using tfc::Trailing;
+using tfc::Job;
 
 
 /**
@@ -42,9 +51,9 @@ class Config
 private:
 //- Hide the default constructor and destructor.
     Config(void) : 
-        name{PACKAGE}, inputFile{}, outputFile{}, replace{},
+        name{PACKAGE}, inputFiles{}, listFile{}, nulSeparated{}, outputFile{}, replace{}, watch{},
         leading{Whitespace::unspecified}, trailing{EndOfLine::unspecified},
-        tabSize{4}, debug{}
+        tabSize{4}, blockSize{256 * 1024}, buffers{4}, mapping{}, jobs{1}, jobsSet{}, uring{}, uncached{}, sync{}, cacheFile{}, cacheDirectory{}, socket{}, serving{}, debug{}
         {  }
     virtual ~Config(void) {}
 
@@ -54,23 +63,53 @@ private:
     enum class EndOfLine { unspecified, dos, unix };
 
     std::string name;
-    std::filesystem::path inputFile;
+    std::vector<std::filesystem::path> inputFiles;
+    std::filesystem::path listFile;
+    bool nulSeparated;
     std::filesystem::path outputFile;
     bool replace;
+    bool watch;
     Whitespace leading;
     EndOfLine trailing;
     size_t tabSize;
+    size_t blockSize;
+    size_t buffers;
+    bool mapping;
+    size_t jobs;
+    bool jobsSet;
+    bool uring;
+    bool uncached;
+    bool sync;
+    std::filesystem::path cacheFile;
+    std::filesystem::path cacheDirectory;
+    std::filesystem::path socket;
+    bool serving;
     bool debug;
 
     void setName(std::string value) { name = value; }
-    void setInputFile(std::string name) { inputFile = name; }
+    void setInputFile(std::string name) { inputFiles.push_back(name); }
     void setOutputFile(std::string name) { outputFile = name; }
-    void setReplaceFile(std::string name) { inputFile = name; replace = true; }
+    void setReplaceFile(std::string name) { inputFiles.push_back(name); replace = true; }
+    void enableReplace(void) { replace = true; }
+    void setWatchDirectory(std::string name) { inputFiles.push_back(name); watch = true; }
+    void setListFile(std::string name) { listFile = name; }
+    void enableNulSeparated(void) { nulSeparated = true; }
     void setSpaces() { leading = Whitespace::space; }
     void setTabs() { leading = Whitespace::tab; }
     void setDos() { trailing = EndOfLine::dos; }
     void setUnix() { trailing = EndOfLine::unix; }
     void setTabSize(size_t size) { tabSize = size; }
+    void setBlockSize(int kib) { blockSize = kib < 0 ? 0 : size_t(kib) * 1024; }
+    void setBuffers(int count) { buffers = count < 0 ? 0 : count; }
+    void enableMapping(void) { mapping = true; }
+    void setJobs(int count) { jobs = count < 0 ? 0 : count; jobsSet = true; }
+    void enableUring(void) { uring = true; }
+    void disableCaching(void) { uncached = true; }
+    void enableSync(void) { sync = true; }
+    void setCacheFile(std::string name) { cacheFile = name; }
+    void setCacheDirectory(std::string name) { cacheDirectory = name; }
+    void setDaemonSocket(std::string name) { socket = name; serving = true; }
+    void setClientSocket(std::string name) { socket = name; serving = false; }
     void enableDebug(void) {debug = true; }
 
     int version(void);
@@ -88,11 +127,17 @@ public:
     static Config & instance() { static Config neo; return neo; }
 
     static std::string & getName(void) { return instance().name; }
-    static std::filesystem::path & getInputFile(void)     { return instance().inputFile; }
+    static const std::filesystem::path & getInputFile(void);
+    static const std::vector<std::filesystem::path> & getInputFiles(void) { return instance().inputFiles; }
+    static const std::filesystem::path & getListFile(void) { return instance().listFile; }
+    static bool isListing(void) { return !instance().listFile.empty(); }
+    static char getListSeparator(void) { return instance().nulSeparated ? '\0' : '\n'; }
     static std::filesystem::path & getOutputFile(void)    { return instance().outputFile; }
 
     static bool isName(void) { return !instance().name.empty(); }
     static bool isReplacing(void) { return instance().replace; }
+    static bool isWatching(void) { return instance().watch; }
+    static bool isBatch(void);
 
     static bool isLeadingSet(void) { return instance().leading != Whitespace::unspecified; }
     static bool isSpace(void) { return instance().leading == Whitespace::space; }
@@ -103,6 +148,22 @@ public:
     static bool isUnix(void) { return instance().trailing == EndOfLine::unix; }
 
     static size_t getTabSize(void) { return instance().tabSize; }
+    static size_t getBlockSize(void) { return instance().blockSize; }
+    static size_t getBuffers(void) { return instance().buffers; }
+    static bool isMapping(void) { return instance().mapping; }
+    static size_t getJobs(void);
+    static bool isUring(void) { return instance().uring; }
+    static bool isUncached(void) { return instance().uncached; }
+    static bool isSyncing(void) { return instance().sync; }
+    static const std::filesystem::path & getCacheFile(void) { return instance().cacheFile; }
+    static bool isCaching(void) { return !instance().cacheFile.empty(); }
+    static const std::filesystem::path & getCacheDirectory(void) { return instance().cacheDirectory; }
+    static bool isContentCaching(void) { return !instance().cacheDirectory.empty(); }
+    static const std::filesystem::path & getSocket(void) { return instance().socket; }
+    static bool isServing(void) { return instance().serving; }
+    static bool isClient(void) { return (!instance().socket.empty()) && (!instance().serving); }
+    static Options getOptions(void);
+    static Job getJob(void);
 
     static bool isChangeRequested(void) { return isLeadingSet() || isTrailingSet(); }
     static bool isSummary(void) { return !isChangeRequested(); }
@@ -0,0 +1,702 @@
+/**
+ * @file    daemon.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the resident daemon and of the client that uses it.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "tfc.h"
+#include "libtfc.h"
+#include "configuration.h"
+#include "parallel.h"
+
+
+/**
+ * @section Internal constants and variables.
+ *
+ * A client sends a request header followed by the name to display the
+ * summary under and the contents of the file, unless it passes the file it
+ * has opened along with the header instead. The daemon only ever reads
+ * files opened by its clients, so it cannot be used to read a file that the
+ * client could not. It replies with a response header followed by the
+ * summary or the transformed contents, then any error message. Any number
+ * of requests may be sent over a connection. Both ends are the same program
+ * on the same host, so the headers are sent in native byte order.
+ */
+
+struct Request
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t leading;
+    uint8_t trailing;
+    uint8_t debug;
+    uint32_t tabSize;
+    uint32_t descriptor;
+    uint32_t nameLength;
+    uint32_t reserved;
+    uint64_t dataLength;
+};
+
+struct Response
+{
+    char magic[4];
+    int32_t status;
+    uint64_t outputLength;
+    uint64_t errorLength;
+};
+
+static constexpr uint8_t version{2};
+static constexpr uint64_t maxDataLength{uint64_t{1} << 32};
+
+//- Buffers bigger than this are released after the request.
+static constexpr size_t keepLimit{4 * 1024 * 1024};
+
+//- A client that takes no more of its reply for this long is dropped.
+static constexpr int sendTimeout{10 * 1000};
+
+static bool readAll(int fd, void *buffer, size_t length)
+{
+    char *next{static_cast<char *>(buffer)};
+    while (length)
+    {
+        const ssize_t count{::read(fd, next, length)};
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if (count == 0)
+            return false;
+
+        next += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+static bool writeAll(int fd, const void *buffer, size_t length)
+{
+    const char *next{static_cast<const char *>(buffer)};
+    while (length)
+    {
+        const ssize_t count{::send(fd, next, length, MSG_NOSIGNAL)};
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            pollfd writable{fd, POLLOUT, 0};
+            if ((errno == EAGAIN) && (::poll(&writable, 1, sendTimeout) > 0))
+                continue;
+
+            return false;
+        }
+
+        next += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+/**
+ * Send the request header, passing the descriptor of the file to be
+ * processed along with it if there is one.
+ *
+ * @param  fd - the connection to the daemon.
+ * @param  request - the request header.
+ * @param  file - the descriptor to pass, or -1 if there is none.
+ * @return true if the whole header was sent.
+ */
+static bool sendHeader(int fd, const Request &request, int file)
+{
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof file)]{};
+    iovec vector{const_cast<Request *>(&request), sizeof request};
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    if (file >= 0)
+    {
+        message.msg_control = control;
+        message.msg_controllen = sizeof control;
+
+        cmsghdr *header{CMSG_FIRSTHDR(&message)};
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof file);
+        std::memcpy(CMSG_DATA(header), &file, sizeof file);
+    }
+
+    ssize_t count{};
+    do
+    {
+        count = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    }
+    while ((count < 0) && (errno == EINTR));
+
+    if (count <= 0)
+        return false;
+
+    return writeAll(fd, reinterpret_cast<const char *>(&request) + count, sizeof request - count);
+}
+
+/**
+ * Fill in the address of the socket.
+ *
+ * @param  path - of the socket.
+ * @param  address - updated with the address.
+ * @return true if the path fits in the address.
+ */
+static bool makeAddress(const std::filesystem::path & path, sockaddr_un &address)
+{
+    const std::string & name{path.native()};
+    if ((name.empty()) || (name.size() >= sizeof address.sun_path))
+    {
+        std::cerr << "Invalid socket name " << path << '\n';
+
+        return false;
+    }
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+
+    return true;
+}
+
+
+/**
+ * @section Daemon.
+ *
+ * The connections are watched with epoll, each armed for a single event.
+ * The loop reads what has arrived of a request without waiting for the
+ * rest, so a client that is slow to send it, or sends nothing at all, does
+ * not hold a worker. Once the whole request is in, it becomes one task on
+ * the work pool, so a connection is never used by two threads at once.
+ * Each worker keeps its buffers from one request to the next, so a warm
+ * worker does not allocate for small files.
+ */
+
+struct Buffers
+{
+    std::vector<char> input;
+    std::vector<char> output;
+    std::string text;
+};
+
+/**
+ * A connection to a client and as much of its request as has arrived.
+ */
+struct Connection
+{
+    explicit Connection(int client) : fd{client}, file{-1}, request{}, received{}, name{}, contents{} {}
+    ~Connection(void) { reset(); ::close(fd); }
+
+//- Delete the copy constructor and assignement operator.
+    Connection(const Connection &) = delete;
+    void operator=(const Connection &) = delete;
+
+    void reset(void);
+
+    int fd;
+    int file;
+    Request request;
+    size_t received;
+    std::string name;
+    std::vector<char> contents;
+};
+
+/**
+ * Get ready for the next request, closing the file passed with the last
+ * one and keeping the buffer warm, unless it is unusually big.
+ */
+void Connection::reset(void)
+{
+    if (file >= 0)
+        ::close(file);
+
+    file = -1;
+    received = 0;
+    if (contents.capacity() > keepLimit)
+        contents = {};
+}
+
+/**
+ * Read the rest of a file into the buffer. A client's file is never mapped,
+ * as the daemon would be killed by SIGBUS if the file were truncated while
+ * it was being read.
+ *
+ * @param  fd - of the open file, left open.
+ * @param  buffer - updated with the contents.
+ * @param  data - updated with the contents.
+ * @return true if the file was read.
+ */
+static bool load(int fd, std::vector<char> &buffer, std::span<const char> &data)
+{
+//- A regular file is read in one go, with room to see the end of it.
+    struct stat info{};
+    size_t expected{};
+    if ((::fstat(fd, &info) == 0) && (S_ISREG(info.st_mode)))
+        expected = static_cast<size_t>(info.st_size) + 1;
+
+    size_t length{};
+    buffer.resize(std::max<size_t>({buffer.capacity(), expected, 64 * 1024}));
+    for (;;)
+    {
+        if (length == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        const ssize_t count{::read(fd, buffer.data() + length, buffer.size() - length)};
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if (count == 0)
+            break;
+
+        length += count;
+    }
+
+    data = {buffer.data(), length};
+
+    return true;
+}
+
+/**
+ * @return true if the descriptor passed is of a regular file, which can be
+ * read without waiting on the client.
+ */
+static bool isRegular(int fd)
+{
+    struct stat info{};
+
+    return (::fstat(fd, &info) == 0) && (S_ISREG(info.st_mode));
+}
+
+/**
+ * @return true if the request header is one this daemon understands.
+ */
+static bool isValid(const Request &request)
+{
+    return (std::memcmp(request.magic, "tfcQ", sizeof request.magic) == 0) &&
+        (request.version == version) &&
+        (request.leading <= static_cast<uint8_t>(Leading::tab)) &&
+        (request.trailing <= static_cast<uint8_t>(Trailing::lf)) &&
+        ((request.tabSize == 2) || (request.tabSize == 4) || (request.tabSize == 8)) &&
+        (request.descriptor <= 1) && (request.nameLength < PATH_MAX) &&
+        (request.dataLength <= maxDataLength) &&
+        ((request.descriptor == 0) || (request.dataLength == 0));
+}
+
+enum class Progress { waiting, complete, failed };
+
+/**
+ * Read as much of the request as has arrived, without waiting for the
+ * rest. The descriptor of the file to be processed, if any, comes with the
+ * first byte of the header.
+ *
+ * @param  connection - the connection to the client.
+ * @return whether the request is complete, or the connection is to be
+ * dropped.
+ */
+static Progress receive(Connection &connection)
+{
+    constexpr size_t header{sizeof connection.request};
+    for (;;)
+    {
+        char *next{reinterpret_cast<char *>(&connection.request) + connection.received};
+        size_t wanted{header - std::min(connection.received, header)};
+        if (!wanted)
+        {
+            const size_t offset{connection.received - header};
+            if (offset < connection.name.size())
+            {
+                next = connection.name.data() + offset;
+                wanted = connection.name.size() - offset;
+            }
+            else
+            {
+                const size_t start{offset - connection.name.size()};
+                if (start == connection.contents.size())
+                    return Progress::complete;
+
+                next = connection.contents.data() + start;
+                wanted = connection.contents.size() - start;
+            }
+        }
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof connection.file)]{};
+        iovec vector{next, wanted};
+        msghdr message{};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof control;
+
+        const ssize_t count{::recvmsg(connection.fd, &message, MSG_CMSG_CLOEXEC)};
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return (errno == EAGAIN) ? Progress::waiting : Progress::failed;
+        }
+
+        if (count == 0)
+            return Progress::failed;
+
+        const cmsghdr *passed{CMSG_FIRSTHDR(&message)};
+        if ((passed) && (passed->cmsg_level == SOL_SOCKET) && (passed->cmsg_type == SCM_RIGHTS))
+        {
+            int file{};
+            std::memcpy(&file, CMSG_DATA(passed), sizeof file);
+            if ((connection.received) || (connection.file >= 0))
+            {
+                ::close(file);
+
+                return Progress::failed;
+            }
+
+            connection.file = file;
+        }
+
+        connection.received += count;
+        if (connection.received == header)
+        {
+            const Request &request{connection.request};
+            if ((!isValid(request)) || ((request.descriptor != 0) != (connection.file >= 0)))
+                return Progress::failed;
+
+            connection.name.assign(request.nameLength, '\0');
+            connection.contents.resize(request.dataLength);
+        }
+    }
+}
+
+/**
+ * Serve a request that has been read in full.
+ *
+ * @param  connection - the connection to the client, with the request.
+ * @return true if the connection can be used for another request.
+ */
+static bool serve(Connection &connection)
+{
+    thread_local Buffers buffers{};
+
+    const Request &request{connection.request};
+    const std::string &name{connection.name};
+    std::span<const char> data{connection.contents};
+    std::string error{};
+    if ((connection.file >= 0) && ((!isRegular(connection.file)) || (!load(connection.file, buffers.input, data))))
+        error = "Unable to read file \"" + name + "\"\n";
+
+    Options options{};
+    options.leading = static_cast<Leading>(request.leading);
+    options.trailing = static_cast<Trailing>(request.trailing);
+    options.tabSize = request.tabSize;
+    options.debug = request.debug;
+
+    std::span<const char> output{};
+    if (error.empty())
+    {
+        if (options.isChangeRequested())
+        {
+            buffers.output.clear();
+            tfc::transform(std::as_bytes(data), options, [&](std::span<const std::byte> block)
+            {
+                const auto *first{reinterpret_cast<const char *>(block.data())};
+                buffers.output.insert(buffers.output.end(), first, first + block.size());
+            });
+            output = buffers.output;
+        }
+        else
+        {
+            buffers.text.clear();
+            std::ostringstream os{std::move(buffers.text)};
+            tfc::display(os, tfc::summarize(std::as_bytes(data)), name, options.debug);
+            buffers.text = std::move(os).str();
+            output = buffers.text;
+        }
+    }
+
+    const Response response{{'t', 'f', 'c', 'R'}, error.empty() ? 0 : 1, output.size(), error.size()};
+
+    const int client{connection.fd};
+    const bool sent{(writeAll(client, &response, sizeof response)) &&
+        (writeAll(client, output.data(), output.size())) &&
+        (writeAll(client, error.data(), error.size()))};
+
+//- Keep the buffers warm, but not the memory of an unusually big request.
+    if (buffers.input.capacity() > keepLimit)
+        buffers.input = {};
+    if (buffers.output.capacity() > keepLimit)
+        buffers.output = {};
+    connection.reset();
+
+    return sent;
+}
+
+/**
+ * Watch the connection for the next event.
+ *
+ * @param  poller - the epoll instance.
+ * @param  connection - the connection to the client.
+ * @param  operation - to add the connection or to arm it again.
+ * @return true if the connection is being watched.
+ */
+static bool arm(int poller, Connection &connection, int operation)
+{
+    epoll_event event{EPOLLIN | EPOLLONESHOT, {.ptr = &connection}};
+
+    return ::epoll_ctl(poller, operation, connection.fd, &event) == 0;
+}
+
+/**
+ * Serve requests on the socket given until killed.
+ *
+ * @return error value.
+ */
+int processDaemon(void)
+{
+    const auto & path{Config::getSocket()};
+    sockaddr_un address{};
+    if (!makeAddress(path, address))
+        return 1;
+
+    const int listener{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (listener < 0)
+    {
+        std::cerr << "Unable to create socket " << path << '\n';
+
+        return 1;
+    }
+
+//- A socket left behind by a daemon that has gone can be replaced, but not
+//- the socket of a daemon that is still running.
+    struct stat info{};
+    if ((::lstat(path.c_str(), &info) == 0) && (S_ISSOCK(info.st_mode)))
+    {
+        if (::connect(listener, reinterpret_cast<const sockaddr *>(&address), sizeof address) == 0)
+        {
+            std::cerr << "A daemon is already listening on socket " << path << '\n';
+
+            return 1;
+        }
+
+        ::unlink(path.c_str());
+    }
+
+//- The socket is created for the owner alone, whatever the umask.
+    const mode_t mask{::umask(S_IRWXG | S_IRWXO | S_IXUSR)};
+    const bool bound{::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof address) == 0};
+    ::umask(mask);
+
+    if ((!bound) || (::chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0) ||
+        (::listen(listener, SOMAXCONN) != 0))
+    {
+        std::cerr << "Unable to listen on socket " << path << '\n';
+
+        return 1;
+    }
+
+    const int poller{::epoll_create1(EPOLL_CLOEXEC)};
+    epoll_event event{EPOLLIN, {.ptr = nullptr}};
+    if ((poller < 0) || (::epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event) != 0))
+    {
+        std::cerr << "Unable to wait for requests\n";
+
+        return 1;
+    }
+
+    tfc::WorkPool pool{Config::getJob().jobs};
+    for (;;)
+    {
+        epoll_event ready[64];
+        const int count{::epoll_wait(poller, ready, 64, -1)};
+        if ((count < 0) && (errno != EINTR))
+        {
+            std::cerr << "Unable to wait for requests\n";
+
+            return 1;
+        }
+
+//- Each connection belongs to the loop while its request arrives and to a
+//- worker while it is served, and is deleted by whichever drops it.
+        for (int i{}; i < count; ++i)
+        {
+            auto *connection{static_cast<Connection *>(ready[i].data.ptr)};
+            if (!connection)
+            {
+                const int client{::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)};
+                if (client < 0)
+                    continue;
+
+                connection = new Connection{client};
+                if (!arm(poller, *connection, EPOLL_CTL_ADD))
+                    delete connection;
+
+                continue;
+            }
+
+            const Progress progress{receive(*connection)};
+            if (progress == Progress::complete)
+            {
+                pool.submit([poller, connection]()
+                {
+                    if ((!serve(*connection)) || (!arm(poller, *connection, EPOLL_CTL_MOD)))
+                        delete connection;
+                });
+            }
+            else
+            if ((progress == Progress::failed) || (!arm(poller, *connection, EPOLL_CTL_MOD)))
+            {
+                delete connection;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @section Client.
+ *
+ */
+
+/**
+ * Send the file given to the daemon listening on the socket given, with the
+ * options given, and output the reply as if the file had been processed
+ * here. A regular file is opened here and passed to the daemon, anything
+ * else is read here and its contents sent.
+ *
+ * @return error value or 0 if no errors.
+ */
+int processClient(void)
+{
+    const auto & path{Config::getSocket()};
+    sockaddr_un address{};
+    if (!makeAddress(path, address))
+        return 1;
+
+    const int fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if ((fd < 0) || (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof address) != 0))
+    {
+        std::cerr << "Unable to connect to daemon on socket " << path << '\n';
+
+        return 1;
+    }
+
+    const auto & file{Config::getInputFile()};
+    const Options options{Config::getOptions()};
+
+    std::string name{file.string()};
+    int passed{file == "-" ? ::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0) : ::open(file.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (passed < 0)
+    {
+        std::cerr << "Unable to open file " << file << '\n';
+
+        return 1;
+    }
+
+    std::vector<char> data{};
+    if (!isRegular(passed))
+    {
+        std::span<const char> contents{};
+        const bool loaded{load(passed, data, contents)};
+        ::close(passed);
+        passed = -1;
+
+        if (!loaded)
+        {
+            std::cerr << "Unable to read file " << file << '\n';
+
+            return 1;
+        }
+
+        data.resize(contents.size());
+    }
+
+    Request request{{'t', 'f', 'c', 'Q'}, version,
+        static_cast<uint8_t>(options.leading), static_cast<uint8_t>(options.trailing), options.debug,
+        static_cast<uint32_t>(options.tabSize), passed >= 0 ? 1u : 0u,
+        static_cast<uint32_t>(name.size()), 0, data.size()};
+
+    const bool sent{(sendHeader(fd, request, passed)) && (writeAll(fd, name.data(), name.size())) &&
+        (writeAll(fd, data.data(), data.size()))};
+    if (passed >= 0)
+        ::close(passed);
+
+    Response response{};
+    if ((!sent) ||
+        (!readAll(fd, &response, sizeof response)) || (std::memcmp(response.magic, "tfcR", sizeof response.magic) != 0))
+    {
+        std::cerr << "No reply from daemon on socket " << path << '\n';
+
+        return 1;
+    }
+
+    std::vector<char> output(response.outputLength);
+    std::string error(response.errorLength, '\0');
+    if ((!readAll(fd, output.data(), output.size())) || (!readAll(fd, error.data(), error.size())))
+    {
+        std::cerr << "Incomplete reply from daemon on socket " << path << '\n';
+
+        return 1;
+    }
+    ::close(fd);
+
+    std::cerr << error;
+    if (std::ofstream os{Config::getOutputFile(), std::ios::binary})
+        os.write(output.data(), output.size());
+    else
+        std::cout.write(output.data(), output.size());
+
+    return response.status;
+}
+
@@ -0,0 +1,265 @@
+/**
+ * @file    input.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the block input shared by the summary and the transform.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "input.h"
+#include "pipe.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Block input implementation.
+ *
+ */
+
+/**
+ * @return the size of the pages that mincore(2) reports on.
+ */
+static size_t pageSize(void)
+{
+    static const size_t size{static_cast<size_t>(::sysconf(_SC_PAGESIZE))};
+
+    return size;
+}
+
+/**
+ * Open the input file, or duplicate standard input for "-" so that it is
+ * closed like any other file. Uncached input is opened with O_DIRECT if
+ * the filesystem supports it.
+ */
+static int openFile(const std::filesystem::path & file, bool uncached)
+{
+    if (file == "-")
+        return ::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+
+    if (uncached)
+    {
+        const int fd{::open(file.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT)};
+        if ((fd >= 0) || (errno != EINVAL))
+            return fd;
+    }
+
+    return ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * Open the input file and either map it or allocate an aligned block to
+ * read it into.
+ *
+ * @param  file - path of the input file, or - for standard input.
+ * @param  size - requested block size, clamped to the supported range.
+ * @param  mode - map the file if it is big enough, or whenever possible.
+ * @param  bypass - leave the page cache as it was found.
+ */
+Input::Input(const std::filesystem::path & file, size_t size, Mode mode, bool bypass) :
+    path{file}, fd{openFile(file, bypass)}, error{}, regular{}, fileSize{},
+    blockSize{std::clamp(size, minBlockSize, maxBlockSize)}, block{},
+    map{}, mapSize{}, offset{}, uncached{bypass}, direct{}, position{}, resident{}
+{
+    if (fd < 0)
+        return;
+
+    direct = (::fcntl(fd, F_GETFL) & O_DIRECT) != 0;
+
+//- Standard input may have been partly read already, so it is picked up
+//- where it was left. A pipe cannot seek, so it starts at zero.
+    const off_t start{::lseek(fd, 0, SEEK_CUR)};
+    if (start > 0)
+        position = static_cast<size_t>(start);
+
+    blockSize = ((blockSize + alignment - 1) / alignment) * alignment;
+    if (mapFile(mode))
+        return;
+
+    block = static_cast<char *>(std::aligned_alloc(alignment, blockSize));
+    if (!block)
+    {
+        ::close(fd);
+        fd = -1;
+
+        return;
+    }
+
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    growPipe(fd, blockSize);
+}
+
+Input::~Input(void)
+{
+    if (map)
+        ::munmap(map, mapSize);
+
+    if ((uncached) && (fd >= 0))
+        drop();
+
+    if (fd >= 0)
+        ::close(fd);
+
+    std::free(block);
+}
+
+/**
+ * Map the input file if it is a regular file and the mode allows it.
+ *
+ * @param  mode - map the file if it is big enough, or whenever possible.
+ * @return true if the file is mapped, false if it should be read instead.
+ */
+bool Input::mapFile(Mode mode)
+{
+    struct stat info{};
+    if ((::fstat(fd, &info) != 0) || (!S_ISREG(info.st_mode)))
+        return false;
+
+    regular = true;
+    fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize == 0)
+        return false;
+
+    mapSize = fileSize;
+    if ((mode == Mode::automatic) && ((uncached) || (mapSize < mapThreshold)))
+        return false;
+
+//- The mapping always starts at the beginning of the file, so input that is
+//- already part read is read from where it is instead.
+    if (position != 0)
+        return false;
+
+    void *address{::mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0)};
+    if (address == MAP_FAILED)
+        return false;
+
+    map = static_cast<char *>(address);
+    if (uncached)
+    {
+        resident.resize((mapSize + pageSize() - 1) / pageSize());
+        if (::mincore(map, mapSize, resident.data()) != 0)
+            resident.assign(resident.size(), 1);
+    }
+
+    ::madvise(map, mapSize, MADV_SEQUENTIAL);
+    ::madvise(map, std::min(mapSize, blockSize), MADV_WILLNEED);
+
+    return true;
+}
+
+/**
+ * Hand out the next block of the mapping and ask for the one after it to
+ * be paged in while this one is processed.
+ *
+ * @return the next block, empty at the end of the file.
+ */
+std::span<const char> Input::next(void)
+{
+    const size_t length{std::min(blockSize, mapSize - offset)};
+    const std::span<const char> ret{map + offset, length};
+    offset += length;
+
+    if (offset < mapSize)
+        ::madvise(map + offset, std::min(blockSize, mapSize - offset), MADV_WILLNEED);
+
+    return ret;
+}
+
+/**
+ * Read the next block of the input file into the buffer given, or hand out
+ * the next block of the mapping instead.
+ *
+ * @param  buffer - to read the block into, at most the block size.
+ * @return the bytes read, empty at the end of the file or on error.
+ */
+std::span<const char> Input::read(std::span<char> buffer)
+{
+    if ((fd < 0) || (error))
+        return {};
+
+    if (map)
+        return next();
+
+    for (;;)
+    {
+        const auto length{::read(fd, buffer.data(), buffer.size())};
+        if (length >= 0)
+        {
+            if ((uncached) && (!direct) && (length > 0))
+                ::posix_fadvise(fd, static_cast<off_t>(position), length, POSIX_FADV_DONTNEED);
+
+            position += static_cast<size_t>(length);
+
+            return { buffer.data(), static_cast<size_t>(length) };
+        }
+
+//- After an unaligned tail, or on a filesystem that turns direct reads
+//- down, carry on through the page cache.
+        if ((errno == EINVAL) && (direct))
+        {
+            direct = false;
+            if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT) == 0)
+                continue;
+        }
+
+        if (errno != EINTR)
+        {
+            error = true;
+
+            return {};
+        }
+    }
+}
+
+/**
+ * Drop the pages of the file brought into the page cache by mapping it,
+ * leaving those that were already there.
+ */
+void Input::drop(void)
+{
+    for (size_t page{}; page < resident.size(); )
+    {
+        if (resident[page] & 1)
+        {
+            ++page;
+
+            continue;
+        }
+
+        const size_t first{page};
+        while ((page < resident.size()) && (!(resident[page] & 1)))
+            ++page;
+
+        ::posix_fadvise(fd, static_cast<off_t>(first * pageSize()), static_cast<off_t>((page - first) * pageSize()), POSIX_FADV_DONTNEED);
+    }
+}
+
+} // namespace tfc
+
@@ -0,0 +1,112 @@
+/**
+ * @file    input.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the block input shared by the summary and the transform.
+ */
+
+#if !defined _INPUT_H_INCLUDED_
+#define _INPUT_H_INCLUDED_
+
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace tfc
+{
+
+
+/**
+ * @section Block input.
+ *
+ * The input file is read in large page aligned blocks directly with
+ * read(2), so the state machines can consume contiguous byte ranges.
+ * Regular files may instead be memory mapped, in which case the blocks are
+ * handed out directly from the mapping without being copied. Pipes and
+ * special files always fall back to read(2), and a pipe is grown to hold a
+ * whole block. Standard input is read when the file is named "-".
+ *
+ * Uncached input leaves the page cache as it found it, for scans of cold
+ * files that would otherwise evict what other programs rely on. A file is
+ * read with O_DIRECT into the aligned blocks, straight from the disk. The
+ * tail of a file leaves the file offset unaligned, so anything after it is
+ * read through the page cache. Where the filesystem does not support
+ * O_DIRECT the file is read through the page cache and the pages are
+ * dropped behind the read. A file is only mapped if asked to be, and the
+ * pages it brings into the page cache are dropped when it is closed.
+ */
+
+class Input
+{
+public:
+    static constexpr size_t minBlockSize{64 * 1024};
+    static constexpr size_t maxBlockSize{4 * 1024 * 1024};
+    static constexpr size_t alignment{4096};
+    static constexpr size_t mapThreshold{32 * 1024 * 1024};
+
+    enum class Mode { automatic, map };
+
+    Input(const std::filesystem::path & file, size_t size, Mode mode = Mode::automatic, bool bypass = false);
+    ~Input(void);
+
+//- Delete the copy constructor and assignement operator.
+    Input(const Input &) = delete;
+    void operator=(const Input &) = delete;
+
+    const std::filesystem::path & getPath(void) const { return path; }
+    bool is_open(void) const { return fd >= 0; }
+    bool isError(void) const { return error; }
+    bool isMapped(void) const { return map != nullptr; }
+    bool isRegular(void) const { return regular; }
+    bool isDirect(void) const { return direct; }
+    size_t getSize(void) const { return fileSize; }
+    size_t getBlockSize(void) const { return blockSize; }
+    std::span<const char> getMapping(void) const { return { map, mapSize }; }
+
+    std::span<const char> read(void) { return read({ block, blockSize }); }
+    std::span<const char> read(std::span<char> buffer);
+
+private:
+    std::filesystem::path path;
+    int fd;
+    bool error;
+    bool regular;
+    size_t fileSize;
+    size_t blockSize;
+    char *block;
+    char *map;
+    size_t mapSize;
+    size_t offset;
+    bool uncached;
+    bool direct;
+    size_t position;
+    std::vector<unsigned char> resident;
+
+    bool mapFile(Mode mode);
+    std::span<const char> next(void);
+    void drop(void);
+};
+
+} // namespace tfc
+
+
+#endif //!defined _INPUT_H_INCLUDED_
+
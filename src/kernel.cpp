@@ -0,0 +1,493 @@
+/**
+ * @file    kernel.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the vectorised byte scanning kernels.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#include "kernel.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Portable scalar reference kernels.
+ *
+ */
+
+static bool isLineEvent(char c)
+{
+    return (c == '\n') || (c == '\r') || (static_cast<unsigned char>(c) > 0x7F);
+}
+
+static const char * findLineEventScalar(const char *first, const char *last)
+{
+    for (; first != last; ++first)
+        if (isLineEvent(*first))
+            return first;
+
+    return last;
+}
+
+static const char * findNewlineScalar(const char *first, const char *last)
+{
+    for (; first != last; ++first)
+        if ((*first == '\n') || (*first == '\r'))
+            return first;
+
+    return last;
+}
+
+static const char * findNonAsciiScalar(const char *first, const char *last)
+{
+    for (; first != last; ++first)
+        if (static_cast<unsigned char>(*first) > 0x7F)
+            return first;
+
+    return last;
+}
+
+/**
+ * Classification of a 64 byte window by UTF-8 role, one bit per byte.
+ */
+struct Utf8Masks
+{
+    uint64_t high;
+    uint64_t cont;
+    uint64_t lead2;
+    uint64_t lead3;
+    uint64_t lead4;
+};
+
+static Utf8Masks classifyUtf8Scalar(const char *first)
+{
+    Utf8Masks masks{};
+    for (int i{}; i < 64; ++i)
+    {
+        const uint64_t bit{uint64_t{1} << i};
+        const unsigned char byte = first[i];
+
+        if (byte < 0x80)
+            continue;
+
+        masks.high |= bit;
+        if (byte < 0xC0)        masks.cont |= bit;
+        else if (byte < 0xE0)   masks.lead2 |= bit;
+        else if (byte < 0xF0)   masks.lead3 |= bit;
+        else if (byte < 0xF8)   masks.lead4 |= bit;
+    }
+
+    return masks;
+}
+
+/**
+ * Find how much of a window is complete multibyte sequences. The prefix
+ * is cut short before a sequence that runs past the contiguous non-ASCII
+ * bytes or past the end of the window.
+ *
+ * @param  m - classification of the window.
+ * @param  run - updated with the length of the prefix and its sequences.
+ * @return true if the non-ASCII bytes may continue in the next window.
+ */
+static bool scanUtf8Window(const Utf8Masks &m, Utf8Run &run)
+{
+    const uint64_t leads{m.lead2 | m.lead3 | m.lead4};
+    const uint64_t expected{(leads << 1) | ((m.lead3 | m.lead4) << 2) | (m.lead4 << 3)};
+    const uint64_t lost{(m.lead2 >> 63) | (m.lead3 >> 62) | (m.lead4 >> 61)};
+
+    const int length{(~m.high) ? __builtin_ctzll(~m.high) : 64};
+    const uint64_t contiguous{(length == 64) ? ~uint64_t{} : (uint64_t{1} << length) - 1};
+
+    int cut{length};
+    if ((expected & ~contiguous) || (lost))
+    {
+        const uint64_t last{leads & contiguous};
+        if (!last)
+            return false;
+
+        cut = 63 - __builtin_clzll(last);
+    }
+
+    const uint64_t prefix{(cut == 64) ? ~uint64_t{} : (uint64_t{1} << cut) - 1};
+    const uint64_t leadsIn{leads & prefix};
+    const uint64_t expectedIn{(leadsIn << 1) | (((m.lead3 | m.lead4) & prefix) << 2) | ((m.lead4 & prefix) << 3)};
+    const uint64_t invalid{m.high & ~(leads | m.cont)};
+
+    if ((expectedIn & ~prefix) || ((m.cont & prefix) != expectedIn) || (invalid & prefix))
+        return false;
+
+    run.length += cut;
+    run.sequences += __builtin_popcountll(leadsIn);
+
+    return (length == 64) && (cut != 0);
+}
+
+/**
+ * Run the window scan over a range, classifying each window with the
+ * given function. A short final window is copied and padded with ASCII.
+ */
+template<typename Classify>
+static Utf8Run scanUtf8With(const char *first, const char *last, Classify classify)
+{
+    Utf8Run run{};
+    for (bool more{true}; (more) && (first + run.length < last); )
+    {
+        const char *window{first + run.length};
+        if (last - window >= 64)
+        {
+            more = scanUtf8Window(classify(window), run);
+        }
+        else
+        {
+            char padded[64]{};
+            std::memcpy(padded, window, last - window);
+            more = scanUtf8Window(classify(padded), run);
+        }
+    }
+
+    return run;
+}
+
+static Utf8Run scanUtf8Scalar(const char *first, const char *last)
+{
+    return scanUtf8With(first, last, classifyUtf8Scalar);
+}
+
+
+#if defined KERNEL_X86
+
+/**
+ * @section SSE2 kernels, 16 bytes at a time.
+ *
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+static const char * findLineEventSse2(const char *first, const char *last)
+{
+    const __m128i lf{_mm_set1_epi8('\n')};
+    const __m128i cr{_mm_set1_epi8('\r')};
+
+    for (; last - first >= 16; first += 16)
+    {
+        const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i *>(first))};
+        const __m128i events{_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)), v)};
+        const unsigned mask = _mm_movemask_epi8(events);
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+
+    return findLineEventScalar(first, last);
+}
+
+static const char * findNewlineSse2(const char *first, const char *last)
+{
+    const __m128i lf{_mm_set1_epi8('\n')};
+    const __m128i cr{_mm_set1_epi8('\r')};
+
+    for (; last - first >= 16; first += 16)
+    {
+        const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i *>(first))};
+        const unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+
+    return findNewlineScalar(first, last);
+}
+
+static const char * findNonAsciiSse2(const char *first, const char *last)
+{
+    for (; last - first >= 16; first += 16)
+    {
+        const unsigned mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(first)));
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+
+    return findNonAsciiScalar(first, last);
+}
+
+/**
+ * Signed comparisons split the non-ASCII bytes into their UTF-8 roles:
+ * below 0xC0 continuation, below 0xE0 two byte lead, below 0xF0 three
+ * byte lead and below 0xF8 four byte lead.
+ */
+static Utf8Masks classifyUtf8Sse2(const char *first)
+{
+    uint64_t below[5]{};
+    const __m128i bounds[5]{ _mm_set1_epi8(0), _mm_set1_epi8(-64), _mm_set1_epi8(-32), _mm_set1_epi8(-16), _mm_set1_epi8(-8) };
+
+    for (int i{}; i < 64; i += 16)
+    {
+        const __m128i v{_mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i))};
+        for (int b{}; b < 5; ++b)
+            below[b] |= uint64_t(unsigned(_mm_movemask_epi8(_mm_cmplt_epi8(v, bounds[b])))) << i;
+    }
+
+    return { below[0], below[1], below[2] & ~below[1], below[3] & ~below[2], below[4] & ~below[3] };
+}
+
+static Utf8Run scanUtf8Sse2(const char *first, const char *last)
+{
+    return scanUtf8With(first, last, classifyUtf8Sse2);
+}
+
+#pragma GCC pop_options
+
+
+/**
+ * @section AVX2 kernels, 32 bytes at a time.
+ *
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static const char * findLineEventAvx2(const char *first, const char *last)
+{
+    const __m256i lf{_mm256_set1_epi8('\n')};
+    const __m256i cr{_mm256_set1_epi8('\r')};
+
+    for (; last - first >= 32; first += 32)
+    {
+        const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(first))};
+        const __m256i events{_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)), v)};
+        const unsigned mask = _mm256_movemask_epi8(events);
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+
+    return findLineEventScalar(first, last);
+}
+
+static const char * findNewlineAvx2(const char *first, const char *last)
+{
+    const __m256i lf{_mm256_set1_epi8('\n')};
+    const __m256i cr{_mm256_set1_epi8('\r')};
+
+    for (; last - first >= 32; first += 32)
+    {
+        const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(first))};
+        const unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+
+    return findNewlineScalar(first, last);
+}
+
+static const char * findNonAsciiAvx2(const char *first, const char *last)
+{
+    for (; last - first >= 32; first += 32)
+    {
+        const unsigned mask = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(first)));
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+
+    return findNonAsciiScalar(first, last);
+}
+
+static Utf8Masks classifyUtf8Avx2(const char *first)
+{
+    uint64_t below[5]{};
+    const __m256i bounds[5]{ _mm256_set1_epi8(0), _mm256_set1_epi8(-64), _mm256_set1_epi8(-32), _mm256_set1_epi8(-16), _mm256_set1_epi8(-8) };
+
+    for (int i{}; i < 64; i += 32)
+    {
+        const __m256i v{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i))};
+        for (int b{}; b < 5; ++b)
+            below[b] |= uint64_t(unsigned(_mm256_movemask_epi8(_mm256_cmpgt_epi8(bounds[b], v)))) << i;
+    }
+
+    return { below[0], below[1], below[2] & ~below[1], below[3] & ~below[2], below[4] & ~below[3] };
+}
+
+static Utf8Run scanUtf8Avx2(const char *first, const char *last)
+{
+    return scanUtf8With(first, last, classifyUtf8Avx2);
+}
+
+#pragma GCC pop_options
+
+
+/**
+ * @section AVX-512 kernels, 64 bytes at a time.
+ *
+ * The tail is handled with a masked load so there is no scalar remainder.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+static uint64_t tailMask(const char *first, const char *last)
+{
+    const auto length{last - first};
+
+    return (length >= 64) ? ~uint64_t{} : (uint64_t{1} << length) - 1;
+}
+
+static const char * findLineEventAvx512(const char *first, const char *last)
+{
+    const __m512i lf{_mm512_set1_epi8('\n')};
+    const __m512i cr{_mm512_set1_epi8('\r')};
+
+    for (; first < last; first += 64)
+    {
+        const __m512i v{_mm512_maskz_loadu_epi8(tailMask(first, last), first)};
+        const uint64_t mask{_mm512_cmpeq_epi8_mask(v, lf) | _mm512_cmpeq_epi8_mask(v, cr) | _mm512_movepi8_mask(v)};
+        if (mask)
+            return first + __builtin_ctzll(mask);
+    }
+
+    return last;
+}
+
+static const char * findNewlineAvx512(const char *first, const char *last)
+{
+    const __m512i lf{_mm512_set1_epi8('\n')};
+    const __m512i cr{_mm512_set1_epi8('\r')};
+
+    for (; first < last; first += 64)
+    {
+        const __m512i v{_mm512_maskz_loadu_epi8(tailMask(first, last), first)};
+        const uint64_t mask{_mm512_cmpeq_epi8_mask(v, lf) | _mm512_cmpeq_epi8_mask(v, cr)};
+        if (mask)
+            return first + __builtin_ctzll(mask);
+    }
+
+    return last;
+}
+
+static const char * findNonAsciiAvx512(const char *first, const char *last)
+{
+    for (; first < last; first += 64)
+    {
+        const uint64_t mask{_mm512_movepi8_mask(_mm512_maskz_loadu_epi8(tailMask(first, last), first))};
+        if (mask)
+            return first + __builtin_ctzll(mask);
+    }
+
+    return last;
+}
+
+static Utf8Masks classifyUtf8Avx512(const char *first)
+{
+    const __m512i v{_mm512_loadu_si512(first)};
+    const uint64_t below64{_mm512_cmplt_epi8_mask(v, _mm512_set1_epi8(-64))};
+    const uint64_t below32{_mm512_cmplt_epi8_mask(v, _mm512_set1_epi8(-32))};
+    const uint64_t below16{_mm512_cmplt_epi8_mask(v, _mm512_set1_epi8(-16))};
+    const uint64_t below8{_mm512_cmplt_epi8_mask(v, _mm512_set1_epi8(-8))};
+
+    return { _mm512_movepi8_mask(v), below64, below32 & ~below64, below16 & ~below32, below8 & ~below16 };
+}
+
+static Utf8Run scanUtf8Avx512(const char *first, const char *last)
+{
+    return scanUtf8With(first, last, classifyUtf8Avx512);
+}
+
+#pragma GCC pop_options
+
+#endif //defined KERNEL_X86
+
+
+/**
+ * @section Run time kernel selection.
+ *
+ */
+
+using FindFunction = const char * (*)(const char *, const char *);
+using ScanUtf8Function = Utf8Run (*)(const char *, const char *);
+
+struct Kernel
+{
+    const char *name;
+    FindFunction findLineEvent;
+    FindFunction findNewline;
+    FindFunction findNonAscii;
+    ScanUtf8Function scanUtf8;
+};
+
+static Kernel selectKernel(void)
+{
+#if defined KERNEL_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512bw"))
+        return { "avx512bw", findLineEventAvx512, findNewlineAvx512, findNonAsciiAvx512, scanUtf8Avx512 };
+
+    if (__builtin_cpu_supports("avx2"))
+        return { "avx2", findLineEventAvx2, findNewlineAvx2, findNonAsciiAvx2, scanUtf8Avx2 };
+
+    if (__builtin_cpu_supports("sse2"))
+        return { "sse2", findLineEventSse2, findNewlineSse2, findNonAsciiSse2, scanUtf8Sse2 };
+#endif
+
+    return { "scalar", findLineEventScalar, findNewlineScalar, findNonAsciiScalar, scanUtf8Scalar };
+}
+
+static const Kernel kernel{selectKernel()};
+
+
+/**
+ * @section Kernel interface.
+ *
+ */
+
+const char * findLineEvent(const char *first, const char *last)
+{
+    return kernel.findLineEvent(first, last);
+}
+
+const char * findNewline(const char *first, const char *last)
+{
+    return kernel.findNewline(first, last);
+}
+
+const char * findNonAscii(const char *first, const char *last)
+{
+    return kernel.findNonAscii(first, last);
+}
+
+Utf8Run scanUtf8(const char *first, const char *last)
+{
+    return kernel.scanUtf8(first, last);
+}
+
+const char * getKernelName(void)
+{
+    return kernel.name;
+}
+
+} // namespace tfc
+
@@ -0,0 +1,98 @@
+/**
+ * @file    kernel.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the vectorised byte scanning kernels.
+ */
+
+#if !defined _KERNEL_H_INCLUDED_
+#define _KERNEL_H_INCLUDED_
+
+#include <cstddef>
+
+namespace tfc
+{
+
+
+/**
+ * @section Byte scanning kernels.
+ *
+ * Each kernel has a portable scalar reference and SSE2, AVX2 and AVX-512
+ * versions. The best version supported by the CPU is selected at run time.
+ */
+
+/**
+ * Find the first byte that is a line feed, a carriage return or has the
+ * high bit set.
+ *
+ * @param  first - pointer to the first byte to check.
+ * @param  last - pointer to one past the last byte to check.
+ * @return pointer to the byte found, or last if there is none.
+ */
+extern const char * findLineEvent(const char *first, const char *last);
+
+/**
+ * Find the first byte that is a line feed or a carriage return.
+ *
+ * @param  first - pointer to the first byte to check.
+ * @param  last - pointer to one past the last byte to check.
+ * @return pointer to the byte found, or last if there is none.
+ */
+extern const char * findNewline(const char *first, const char *last);
+
+/**
+ * Find the first byte that has the high bit set.
+ *
+ * @param  first - pointer to the first byte to check.
+ * @param  last - pointer to one past the last byte to check.
+ * @return pointer to the byte found, or last if there is none.
+ */
+extern const char * findNonAscii(const char *first, const char *last);
+
+/**
+ * Count the complete multibyte UTF-8 sequences at the start of a range.
+ * A sequence is a lead byte followed by the number of continuation bytes
+ * it calls for, which is all the summary checks for.
+ */
+struct Utf8Run
+{
+    size_t length;
+    size_t sequences;
+};
+
+/**
+ * Find a prefix that is made only of complete multibyte UTF-8 sequences.
+ * The scan stops at the first ASCII byte and gives up early on malformed
+ * input, leaving the rest to the caller.
+ *
+ * @param  first - pointer to the first byte to check.
+ * @param  last - pointer to one past the last byte to check.
+ * @return the length of the prefix and the number of sequences in it.
+ */
+extern Utf8Run scanUtf8(const char *first, const char *last);
+
+extern const char * getKernelName(void);
+
+} // namespace tfc
+
+
+#endif //!defined _KERNEL_H_INCLUDED_
+
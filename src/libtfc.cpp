@@ -0,0 +1,152 @@
+/**
+ * @file    libtfc.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of libtfc, the summary and the transform of data in memory.
+ */
+
+#include <ostream>
+#include <streambuf>
+
+#include "libtfc.h"
+#include "state.h"
+#include "status.h"
+#include "output.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Internal constants and variables.
+ *
+ */
+
+static std::span<const char> asChars(std::span<const std::byte> data)
+{
+    return { reinterpret_cast<const char *>(data.data()), data.size() };
+}
+
+//- Passes everything written to a stream straight on to a sink, so that the
+//- transform writes its blocks to the sink without another copy.
+class SinkBuffer : public std::streambuf
+{
+public:
+    explicit SinkBuffer(const Sink &target) : sink{target} {}
+
+protected:
+    std::streamsize xsputn(const char *s, std::streamsize count) override;
+    int_type overflow(int_type c) override;
+
+private:
+    const Sink &sink;
+};
+
+std::streamsize SinkBuffer::xsputn(const char *s, std::streamsize count)
+{
+    if (count > 0)
+        sink(std::as_bytes(std::span{s, static_cast<size_t>(count)}));
+
+    return count;
+}
+
+SinkBuffer::int_type SinkBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    const char event{traits_type::to_char_type(c)};
+    sink(std::as_bytes(std::span{&event, 1}));
+
+    return c;
+}
+
+
+/**
+ * @section In-memory API implementation.
+ *
+ */
+
+/**
+ * Add the counts of another file, for a total over many files.
+ *
+ * @param  other - summary of the other file.
+ */
+Summary & Summary::operator+=(const Summary &other)
+{
+    lines += other.lines;
+    neither += other.neither;
+    spOnly += other.spOnly;
+    tabOnly += other.tabOnly;
+    both += other.both;
+    malformed += other.malformed;
+    dosEOL += other.dosEOL;
+    unixEOL += other.unixEOL;
+    ansi += other.ansi;
+    utf8 += other.utf8;
+
+    return *this;
+}
+
+/**
+ * Summarise the contents of a file.
+ *
+ * @param  data - the whole of the file.
+ * @return the counts found.
+ */
+Summary summarize(std::span<const std::byte> data)
+{
+    State state{};
+    state.process(asChars(data));
+
+    return state.getSummary();
+}
+
+/**
+ * Display a summary in the same format as tfc.
+ *
+ * @param  os - output stream for the summary.
+ * @param  summary - the counts to display.
+ * @param  title - the name to display the summary under.
+ * @param  debug - display the counts on a single line instead.
+ */
+void display(std::ostream &os, const Summary &summary, const std::string & title, bool debug)
+{
+    State{summary}.display(os, title, debug);
+}
+
+/**
+ * Transform the contents of a file.
+ *
+ * @param  data - the whole of the file.
+ * @param  options - the options to transform with.
+ * @param  sink - receives the transformed contents.
+ */
+void transform(std::span<const std::byte> data, const Options &options, const Sink &sink)
+{
+    SinkBuffer buffer{sink};
+    std::ostream os{&buffer};
+    Output out{os};
+    selectTransform(options).memory(asChars(data), out);
+}
+
+} // namespace tfc
+
@@ -0,0 +1,79 @@
+/**
+ * @file    libtfc.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to libtfc, the summary and the transform of data in memory.
+ */
+
+#if !defined _LIBTFC_H_INCLUDED_
+#define _LIBTFC_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+
+#include "options.h"
+
+
+/**
+ * @section In-memory API.
+ *
+ * Everything needed is passed in, so the functions can be called from any
+ * number of threads at once, each with its own options. The data is the
+ * whole of a file, so the first byte is the start of a line.
+ */
+
+namespace tfc
+{
+
+//- The counts found in a file. The caches keep this layout, so changing it
+//- needs a new cache version.
+struct Summary
+{
+    int32_t lines{};
+    int32_t neither{};
+    int32_t spOnly{};
+    int32_t tabOnly{};
+    int32_t both{};
+    int32_t malformed{};
+    int32_t dosEOL{};
+    int32_t unixEOL{};
+    int32_t ansi{};
+    int32_t utf8{};
+
+    Summary & operator+=(const Summary &other);
+};
+
+//- Receives the transformed data in blocks, in order.
+using Sink = std::function<void(std::span<const std::byte> block)>;
+
+extern Summary summarize(std::span<const std::byte> data);
+extern void display(std::ostream &os, const Summary &summary, const std::string & title, bool debug = false);
+extern void transform(std::span<const std::byte> data, const Options &options, const Sink &sink);
+
+} // namespace tfc
+
+
+#endif //!defined _LIBTFC_H_INCLUDED_
+
@@ -0,0 +1,401 @@
+/**
+ * @file    loader.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the loading of many small files through io_uring.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "loader.h"
+#include "input.h"
+
+
+/**
+ * @section io_uring file loading implementation.
+ *
+ * The ring is driven with the raw system calls. Only the Loader's thread
+ * touches the submission and completion queues. The user data of each
+ * request is the slot index and which step of the chain it is.
+ */
+
+static constexpr uint64_t openStep{0};
+static constexpr uint64_t readStep{1};
+static constexpr uint64_t closeStep{2};
+static constexpr uint64_t steps{3};
+
+/**
+ * Set up the ring and start the thread, unless io_uring is not available.
+ *
+ * @param  workers - the pool the tasks are run on.
+ * @param  count - the number of files in flight, capped at maxSlots.
+ * @param  uncached - read the files without filling the page cache.
+ */
+Loader::Loader(tfc::WorkPool &workers, size_t count, bool uncached) :
+    pool{workers}, ring{-1}, rings{MAP_FAILED}, ringsSize{}, sqes{}, sqesSize{},
+    sqTail{}, sqMask{}, sqArray{}, cqHead{}, cqTail{}, cqMask{}, cqes{},
+    openFlags{uncached ? O_RDONLY | O_DIRECT : O_RDONLY}, fixedBuffers{}, memory{nullptr, &std::free}, slots{}, free{}, waiting{},
+    loading{}, prepared{}, queued{}, mutex{}, wake{}, stopping{}, thread{}
+{
+    count = std::clamp(count, size_t{1}, maxSlots);
+    memory.reset(static_cast<char *>(std::aligned_alloc(tfc::Input::alignment, count * bufferSize)));
+    if ((!memory) || (!setup(count)))
+    {
+        close();
+
+        return;
+    }
+
+    slots.resize(count);
+    for (size_t i{}; i < count; ++i)
+    {
+        slots[i].buffer = { memory.get() + i * bufferSize, bufferSize };
+        free.push_back(count - 1 - i);
+    }
+
+    thread = std::thread{&Loader::run, this};
+}
+
+/**
+ * Wait for every file to be loaded and every task to finish.
+ */
+Loader::~Loader(void)
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+            wake.notify_one();
+        }
+
+        thread.join();
+    }
+
+    close();
+}
+
+/**
+ * Create the ring, map its queues and register the file table and the
+ * buffers. Opening straight into the file table and reading from it in
+ * the same chain needs Linux 5.17. Registering the buffers may fail on the
+ * locked memory limit, in which case the reads use the buffers unregistered.
+ *
+ * @param  count - the number of slots.
+ * @return true if the ring is ready, false if io_uring cannot be used.
+ */
+bool Loader::setup(size_t count)
+{
+    io_uring_params params{};
+    const unsigned entries{std::bit_ceil(static_cast<unsigned>(count * steps))};
+    ring = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring < 0)
+        return false;
+
+    const unsigned needed{IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_LINKED_FILE};
+    if ((params.features & needed) != needed)
+        return false;
+
+    ringsSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    rings = ::mmap(nullptr, ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED)
+        return false;
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *address{::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES)};
+    if (address == MAP_FAILED)
+        return false;
+
+    sqes = static_cast<io_uring_sqe *>(address);
+    char *base{static_cast<char *>(rings)};
+    sqTail = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(base + params.cq_off.cqes);
+
+    const size_t probeSize{sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)};
+    std::vector<uint64_t> probeSpace((probeSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    auto *probe{reinterpret_cast<io_uring_probe *>(probeSpace.data())};
+    if (::syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, 256) < 0)
+        return false;
+
+    for (const auto op : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE })
+    {
+        if ((op > probe->last_op) || (!(probe->ops[op].flags & IO_URING_OP_SUPPORTED)))
+            return false;
+    }
+
+    const std::vector<int> files(count, -1);
+    if (::syscall(__NR_io_uring_register, ring, IORING_REGISTER_FILES, files.data(), static_cast<unsigned>(count)) < 0)
+        return false;
+
+    iovec buffers{ memory.get(), count * bufferSize };
+    fixedBuffers = ::syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, &buffers, 1) == 0;
+
+    return true;
+}
+
+/**
+ * Tear down the ring, leaving the Loader closed.
+ */
+void Loader::close(void)
+{
+    if (sqes)
+        ::munmap(sqes, sqesSize);
+
+    if (rings != MAP_FAILED)
+        ::munmap(rings, ringsSize);
+
+    if (ring >= 0)
+        ::close(ring);
+
+    sqes = nullptr;
+    rings = MAP_FAILED;
+    ring = -1;
+}
+
+/**
+ * Queue a file to be loaded and its task to be run with the contents. Only
+ * one thread may add files.
+ *
+ * @param  file - path of the file.
+ * @param  task - run on the work pool once the file is loaded.
+ */
+void Loader::load(const std::filesystem::path & file, Task task)
+{
+    std::lock_guard lock{mutex};
+    waiting.push_back({ file, std::move(task) });
+    wake.notify_one();
+}
+
+/**
+ * @return the next submission queue entry, cleared. There is always room,
+ * as the ring has an entry for every step of every slot.
+ */
+io_uring_sqe * Loader::next(void)
+{
+    const unsigned index{(*sqTail + prepared) & sqMask};
+    sqArray[index] = index;
+    ++prepared;
+
+    io_uring_sqe *sqe{&sqes[index]};
+    *sqe = io_uring_sqe{};
+
+    return sqe;
+}
+
+/**
+ * Queue the open, read and close of the file in a slot as a linked chain.
+ * The read is hard linked to the close so that the slot is closed even if
+ * the read fails. If the open fails the rest of the chain is cancelled.
+ *
+ * @param  index - of the slot.
+ */
+void Loader::start(size_t index)
+{
+    Slot &slot{slots[index]};
+    slot.result = -ECANCELED;
+    slot.loading = true;
+    ++loading;
+
+    io_uring_sqe *sqe{next()};
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(slot.file.c_str());
+    sqe->open_flags = static_cast<uint32_t>(openFlags);
+    sqe->file_index = static_cast<uint32_t>(index + 1);
+    sqe->user_data = index * steps + openStep;
+
+    sqe = next();
+    sqe->opcode = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->fd = static_cast<int32_t>(index);
+    sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.data());
+    sqe->len = static_cast<uint32_t>(slot.buffer.size());
+    sqe->user_data = index * steps + readStep;
+
+    sqe = next();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = static_cast<uint32_t>(index + 1);
+    sqe->user_data = index * steps + closeStep;
+}
+
+/**
+ * Publish the entries prepared, submit every entry not yet taken by the
+ * kernel and wait for at least one completion.
+ *
+ * @return true if the entries were submitted, false if the ring failed.
+ */
+bool Loader::submit(void)
+{
+    std::atomic_ref{*sqTail}.store(*sqTail + prepared, std::memory_order_release);
+    queued += prepared;
+    prepared = 0;
+    for (;;)
+    {
+        const auto ret{::syscall(__NR_io_uring_enter, ring, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0)};
+        if (ret >= 0)
+        {
+            queued -= std::min(queued, static_cast<unsigned>(ret));
+            if (queued == 0)
+                return true;
+        }
+        else if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+            return false;
+
+        complete();
+    }
+}
+
+/**
+ * Take every completion that has arrived. When the close at the end of a
+ * chain completes the file is loaded, and its task is handed to the pool.
+ * Only a read that did not fill the buffer holds the whole file.
+ */
+void Loader::complete(void)
+{
+    unsigned head{*cqHead};
+    const unsigned tail{std::atomic_ref{*cqTail}.load(std::memory_order_acquire)};
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe{cqes[head & cqMask]};
+        const size_t index{static_cast<size_t>(cqe.user_data / steps)};
+        const auto step{cqe.user_data % steps};
+        if (step == readStep)
+            slots[index].result = cqe.res;
+
+        if ((step != closeStep) || (!slots[index].loading))
+            continue;
+
+        const int result{slots[index].result};
+        Contents contents{};
+        if ((result >= 0) && (static_cast<size_t>(result) < bufferSize))
+            contents = slots[index].buffer.first(static_cast<size_t>(result));
+
+        dispatch(index, contents);
+    }
+
+    std::atomic_ref{*cqHead}.store(head, std::memory_order_release);
+}
+
+/**
+ * Hand the task for a loaded file to the pool.
+ *
+ * @param  index - of the slot.
+ * @param  contents - of the file, or none if the task is to read it.
+ */
+void Loader::dispatch(size_t index, Contents contents)
+{
+    slots[index].loading = false;
+    --loading;
+    pool.submit([this, index, contents]()
+    {
+        slots[index].task(contents);
+        release(index);
+    });
+}
+
+/**
+ * Make a slot free for the next file once its task has finished.
+ *
+ * @param  index - of the slot.
+ */
+void Loader::release(size_t index)
+{
+    std::lock_guard lock{mutex};
+    slots[index].task = nullptr;
+    free.push_back(index);
+    wake.notify_one();
+}
+
+/**
+ * Start loading waiting files into free slots, submit them in one go and
+ * take the completions, until stopped with nothing left in flight. Should
+ * the ring fail, the files in flight and every file after them are left
+ * to their tasks to read.
+ */
+void Loader::run(void)
+{
+    bool failed{};
+    std::unique_lock lock{mutex};
+    for (;;)
+    {
+        while ((failed) && (!waiting.empty()))
+        {
+            pool.submit([task = std::move(waiting.front().task)]() { task({}); });
+            waiting.pop_front();
+        }
+
+        while ((!waiting.empty()) && (!free.empty()))
+        {
+            const size_t index{free.back()};
+            free.pop_back();
+            slots[index].file = std::move(waiting.front().file);
+            slots[index].task = std::move(waiting.front().task);
+            waiting.pop_front();
+            start(index);
+        }
+
+        if (loading == 0)
+        {
+            if ((stopping) && (waiting.empty()) && (free.size() == slots.size()))
+                return;
+
+            wake.wait(lock);
+
+            continue;
+        }
+
+        lock.unlock();
+        const bool submitted{submit()};
+        complete();
+        lock.lock();
+
+        if ((!submitted) && (!failed))
+        {
+            std::cerr << "Unable to load files through io_uring\n";
+            failed = true;
+            for (size_t index{}; index < slots.size(); ++index)
+            {
+                if (slots[index].loading)
+                    dispatch(index, {});
+            }
+        }
+    }
+}
+
@@ -0,0 +1,146 @@
+/**
+ * @file    loader.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the loading of many small files through io_uring.
+ */
+
+#if !defined _LOADER_H_INCLUDED_
+#define _LOADER_H_INCLUDED_
+
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "parallel.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+
+/**
+ * @section io_uring file loading.
+ *
+ * Opening, reading and closing a small file costs several system calls,
+ * which for a tree of small files take longer than the files take to
+ * process. The Loader has a thread of its own that submits the open, read
+ * and close of each file to io_uring as a single linked chain, so a whole
+ * batch of files costs one system call. Each file is opened into a slot of
+ * the ring's registered file table and read into a registered buffer of
+ * its own, so neither descriptors nor buffers are looked up per file.
+ *
+ * As each chain completes the task for the file is run on the work pool,
+ * with the contents. A file that fills its buffer may be larger, and a
+ * file that fails to open may be missing, so for these the task is given
+ * no contents and opens the file itself, reporting any error as usual.
+ * The buffer and slot are reused once the task has finished. Uncached
+ * files are opened with O_DIRECT, which the aligned buffers allow; where
+ * the filesystem refuses it the open fails and the task reads the file
+ * itself, without filling the page cache either. Kernels
+ * without the features needed leave the Loader closed, and the caller
+ * falls back to running the tasks directly.
+ */
+
+class Loader
+{
+public:
+    static constexpr size_t bufferSize{64 * 1024};
+    static constexpr size_t maxSlots{1024};
+
+    using Contents = std::optional<std::span<const char>>;
+    using Task = std::function<void(Contents contents)>;
+
+    Loader(tfc::WorkPool &workers, size_t count, bool uncached = false);
+    ~Loader(void);
+
+//- Delete the copy constructor and assignement operator.
+    Loader(const Loader &) = delete;
+    void operator=(const Loader &) = delete;
+
+    bool is_open(void) const { return ring >= 0; }
+
+    void load(const std::filesystem::path & file, Task task);
+
+private:
+    struct Slot
+    {
+        std::filesystem::path file;
+        Task task;
+        std::span<char> buffer;
+        int result;
+        bool loading;
+    };
+
+    struct Waiting
+    {
+        std::filesystem::path file;
+        Task task;
+    };
+
+    tfc::WorkPool &pool;
+    int ring;
+    void *rings;
+    size_t ringsSize;
+    io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    io_uring_cqe *cqes;
+    int openFlags;
+    bool fixedBuffers;
+    std::unique_ptr<char, decltype(&std::free)> memory;
+    std::vector<Slot> slots;
+    std::vector<size_t> free;
+    std::deque<Waiting> waiting;
+    size_t loading;
+    unsigned prepared;
+    unsigned queued;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread thread;
+
+    bool setup(size_t count);
+    void close(void);
+    io_uring_sqe * next(void);
+    void start(size_t index);
+    bool submit(void);
+    void complete(void);
+    void dispatch(size_t index, Contents contents);
+    void release(size_t index);
+    void run(void);
+};
+
+
+#endif //!defined _LOADER_H_INCLUDED_
+
@@ -0,0 +1,88 @@
+/**
+ * @file    options.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the options that control the summary and the transform.
+ */
+
+#if !defined _OPTIONS_H_INCLUDED_
+#define _OPTIONS_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * @section Processing options.
+ *
+ * Plain values that are passed to the engines, rather than read from the
+ * command line, so that every file can be processed with its own settings.
+ * Options holds only the settings that affect the results, so that it can
+ * be sent to a daemon with each request and identify cached results. Job
+ * adds the settings that only affect how the work is done.
+ */
+
+namespace tfc
+{
+
+enum class Leading : unsigned char { unchanged, space, tab };
+enum class Trailing : unsigned char { unchanged, crlf, lf };
+
+struct Options
+{
+    Leading leading{Leading::unchanged};
+    Trailing trailing{Trailing::unchanged};
+    size_t tabSize{4};
+    bool debug{};
+
+    bool isChangeRequested(void) const { return (leading != Leading::unchanged) || (trailing != Trailing::unchanged); }
+    uint64_t getHash(void) const;
+};
+
+//- A hash of the options, so that results found with different options are
+//- never mixed up. The tab size only matters when changing leading whitespace.
+inline uint64_t Options::getHash(void) const
+{
+    uint64_t hash{1};
+    hash = (hash * 31) + static_cast<uint64_t>(leading);
+    hash = (hash * 31) + static_cast<uint64_t>(trailing);
+    hash = (hash * 31) + (leading != Leading::unchanged ? tabSize : 0);
+
+    return hash;
+}
+
+struct Job
+{
+    Options options{};
+    size_t blockSize{256 * 1024};
+    bool mapping{};
+    size_t jobs{1};
+    size_t buffers{1};
+    bool uring{};
+    bool uncached{};
+    bool sync{};
+};
+
+} // namespace tfc
+
+
+#endif //!defined _OPTIONS_H_INCLUDED_
+
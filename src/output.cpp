@@ -0,0 +1,164 @@
+/**
+ * @file    output.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the block buffered output used by the transform.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "output.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Block buffered output implementation.
+ *
+ */
+
+/**
+ * Collect the output in memory instead of writing it to a stream.
+ *
+ * @param  memory - store for the output, which is replaced.
+ */
+Output::Output(std::vector<char> &memory) :
+    os{}, store{&memory}, exchange{}, block{}, buffer{}, next{}
+{
+    store->clear();
+    store->resize(blockSize);
+    buffer = *store;
+    next = buffer.data();
+}
+
+/**
+ * Make room in the block, by writing it to the stream or by growing the
+ * store.
+ *
+ * @param  length - number of characters that need to fit.
+ */
+void Output::overflow(size_t length)
+{
+    if (!store)
+    {
+        flush();
+
+        return;
+    }
+
+    const size_t used = next - buffer.data();
+    store->resize(std::max(store->size() * 2, used + length));
+    buffer = *store;
+    next = buffer.data() + used;
+}
+
+/**
+ * Add a character to the block multiple times.
+ *
+ * @param  c - character to add.
+ * @param  count - number of times to add it.
+ */
+void Output::put(char c, size_t count)
+{
+    while (count)
+    {
+        if (next == end())
+            overflow(count);
+
+        const size_t length{std::min(count, space())};
+        std::memset(next, c, length);
+        next += length;
+        count -= length;
+    }
+}
+
+/**
+ * Add a span of characters to the block, bypassing the block altogether
+ * if the span is too big to fit and there is a stream to write it to. A
+ * span too big for a handed off block is split across as many as needed.
+ *
+ * @param  first - pointer to the first character to add.
+ * @param  length - number of characters to add.
+ */
+void Output::write(const char *first, size_t length)
+{
+    if (length > space())
+    {
+        overflow(length);
+
+        if ((os) && (length >= buffer.size()))
+        {
+            os->write(first, length);
+
+            return;
+        }
+
+        while (length > space())
+        {
+            const size_t part{space()};
+            std::memcpy(next, first, part);
+            next += part;
+            first += part;
+            length -= part;
+            flush();
+        }
+    }
+
+    std::memcpy(next, first, length);
+    next += length;
+}
+
+/**
+ * Write the contents of the block to the stream and empty the block, or
+ * hand the block off in exchange for an empty one. When collecting in
+ * memory the store is trimmed to the output so far instead.
+ */
+void Output::flush(void)
+{
+    if (store)
+    {
+        const size_t used = next - buffer.data();
+        store->resize(used);
+        buffer = *store;
+        next = buffer.data() + used;
+
+        return;
+    }
+
+    if (next == buffer.data())
+        return;
+
+    if (exchange)
+    {
+        buffer = exchange({ buffer.data(), static_cast<size_t>(next - buffer.data()) });
+        next = buffer.data();
+
+        return;
+    }
+
+    os->write(buffer.data(), next - buffer.data());
+    next = buffer.data();
+}
+
+} // namespace tfc
+
@@ -0,0 +1,96 @@
+/**
+ * @file    output.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the block buffered output used by the transform.
+ */
+
+#if !defined _OUTPUT_H_INCLUDED_
+#define _OUTPUT_H_INCLUDED_
+
+#include <iostream>
+#include <vector>
+#include <span>
+#include <functional>
+
+namespace tfc
+{
+
+
+/**
+ * @section Block buffered output.
+ *
+ * Characters are collected in a fixed size block which is only written to
+ * the stream when full or explicitly flushed, so no heap allocation or
+ * formatted insert is needed per character. Alternatively the characters
+ * are collected in memory, growing the store as needed, for output that
+ * has to be held back until it can be written in order. Or else each full
+ * block is handed off whole, to be written by another thread, in exchange
+ * for an empty one.
+ */
+
+class Output
+{
+public:
+    static constexpr size_t blockSize{64 * 1024};
+
+//- Takes a full block and returns an empty one of the same size.
+    using Exchange = std::function<std::span<char>(std::span<char> full)>;
+
+    explicit Output(std::ostream &stream, size_t size = blockSize) :
+        os{&stream}, store{}, exchange{}, block(size), buffer{block}, next{buffer.data()}
+        {}
+    Output(std::ostream &stream, std::span<char> space) :
+        os{&stream}, store{}, exchange{}, block{}, buffer{space}, next{buffer.data()}
+        {}
+    explicit Output(std::vector<char> &memory);
+    Output(Exchange swap, std::span<char> space) :
+        os{}, store{}, exchange{std::move(swap)}, block{}, buffer{space}, next{buffer.data()}
+        {}
+    ~Output(void) { flush(); }
+
+//- Delete the copy constructor and assignement operator.
+    Output(const Output &) = delete;
+    void operator=(const Output &) = delete;
+
+    void put(char c) { if (next == end()) overflow(1); *next++ = c; }
+    void put(char c, size_t count);
+    void write(const char *first, size_t length);
+    void flush(void);
+
+private:
+    std::ostream *os;
+    std::vector<char> *store;
+    Exchange exchange;
+    std::vector<char> block;
+    std::span<char> buffer;
+    char *next;
+
+    char *end(void) { return buffer.data() + buffer.size(); }
+    size_t space(void) { return end() - next; }
+    void overflow(size_t length);
+};
+
+} // namespace tfc
+
+
+#endif //!defined _OUTPUT_H_INCLUDED_
+
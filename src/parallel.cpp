@@ -0,0 +1,294 @@
+/**
+ * @file    parallel.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the worker threads used to process chunks in parallel.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Parallel processing implementation.
+ *
+ */
+
+void runParallel(size_t count, size_t jobs, const std::function<void(size_t)> & task)
+{
+    std::atomic<size_t> next{};
+    auto worker = [&]()
+    {
+        for (size_t i{next++}; i < count; i = next++)
+            task(i);
+    };
+
+    if (count == 0)
+        return;
+
+    const size_t extra{std::clamp(jobs, size_t{1}, count) - 1};
+    if (WorkPool *pool{WorkPool::current()})
+    {
+//- Offer the extra work to idle workers and help out while any of it is
+//- still queued. Once there is nothing left to help with, wait for the
+//- workers that took some to finish. The count is only changed under the
+//- lock, so it is safe to return as soon as it reaches zero.
+        size_t running{extra};
+        std::mutex mutex;
+        std::condition_variable finished;
+        for (size_t i{}; i < extra; ++i)
+            pool->submit([&]()
+            {
+                worker();
+
+                std::lock_guard lock{mutex};
+                if (--running == 0)
+                    finished.notify_all();
+            });
+
+        worker();
+
+        while (pool->help())
+            continue;
+
+        std::unique_lock lock{mutex};
+        finished.wait(lock, [&]() { return running == 0; });
+
+        return;
+    }
+
+    std::vector<std::thread> threads{};
+    for (size_t i{}; i < extra; ++i)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (auto & thread : threads)
+        thread.join();
+}
+
+void runOrdered(size_t count, size_t jobs,
+    const std::function<void(size_t, std::vector<char> &)> & produce,
+    const std::function<void(const std::vector<char> &)> & consume)
+{
+    const size_t window{std::max(jobs, size_t{1}) * 2};
+    std::vector<std::vector<char>> buffers(window);
+    std::vector<bool> ready(count);
+    size_t consumed{};
+    bool consuming{};
+    std::mutex mutex;
+    std::condition_variable progress;
+
+    runParallel(count, jobs, [&](size_t i)
+    {
+        {
+            std::unique_lock lock{mutex};
+            progress.wait(lock, [&]() { return i < consumed + window; });
+        }
+
+        produce(i, buffers[i % window]);
+
+        std::unique_lock lock{mutex};
+        ready[i] = true;
+        if (consuming)
+            return;
+
+//- Consume every buffer that is ready in order, without holding the lock,
+//- while other threads carry on producing.
+        consuming = true;
+        while ((consumed < count) && (ready[consumed]))
+        {
+            lock.unlock();
+            consume(buffers[consumed % window]);
+            lock.lock();
+            ++consumed;
+            progress.notify_all();
+        }
+        consuming = false;
+    });
+}
+
+
+/**
+ * @section Work stealing thread pool implementation.
+ *
+ */
+
+static thread_local WorkPool *currentPool{};
+static thread_local size_t currentIndex{};
+
+/**
+ * Start the workers. The last queue is shared by threads outside the pool.
+ *
+ * @param  threads - number of worker threads.
+ */
+WorkPool::WorkPool(size_t threads) :
+    queues{}, workers{}, queued{}, mutex{}, wake{}, stopping{}
+{
+    threads = std::max(threads, size_t{1});
+    for (size_t i{}; i <= threads; ++i)
+        queues.push_back(std::make_unique<Queue>());
+
+    for (size_t i{}; i < threads; ++i)
+        workers.emplace_back(&WorkPool::work, this, i);
+}
+
+/**
+ * Run every task still queued, then stop the workers.
+ */
+WorkPool::~WorkPool(void)
+{
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto & worker : workers)
+        worker.join();
+}
+
+/**
+ * @return the pool the calling thread is a worker of, if any.
+ */
+WorkPool * WorkPool::current(void)
+{
+    return currentPool;
+}
+
+/**
+ * @return the index of the queue belonging to the calling thread.
+ */
+size_t WorkPool::home(void) const
+{
+    return (currentPool == this) ? currentIndex : workers.size();
+}
+
+/**
+ * Add a task to the calling thread's queue. The task is counted before it
+ * is queued, so the count never falls short of the tasks in the queues and
+ * a thread that finds it at zero can safely stop looking.
+ *
+ * @param  task - function to run on one of the workers.
+ */
+void WorkPool::submit(std::function<void(void)> task)
+{
+    Queue &queue{*queues[home()]};
+    {
+        std::lock_guard lock{mutex};
+        ++queued;
+    }
+    {
+        std::lock_guard lock{queue.mutex};
+        queue.tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+/**
+ * Take a task, newest first from the given queue, otherwise oldest first
+ * from any of the others.
+ *
+ * @param  index - the queue to look in first.
+ * @param  task - updated with the task taken.
+ * @return true if a task was taken.
+ */
+bool WorkPool::take(size_t index, std::function<void(void)> &task)
+{
+    if (!queued)
+        return false;
+
+    for (size_t i{}; i < queues.size(); ++i)
+    {
+        Queue &queue{*queues[(index + i) % queues.size()]};
+        std::lock_guard lock{queue.mutex};
+        if (queue.tasks.empty())
+            continue;
+
+        if (i == 0)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --queued;
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Run one queued task on the calling thread, for use while waiting on
+ * other tasks.
+ *
+ * @return true if a task was run.
+ */
+bool WorkPool::help(void)
+{
+    std::function<void(void)> task{};
+    if (!take(home(), task))
+        return false;
+
+    task();
+
+    return true;
+}
+
+void WorkPool::work(size_t index)
+{
+    currentPool = this;
+    currentIndex = index;
+
+    std::function<void(void)> task{};
+    for (;;)
+    {
+        if (take(index, task))
+        {
+            task();
+            task = nullptr;
+
+            continue;
+        }
+
+        std::unique_lock lock{mutex};
+        wake.wait(lock, [&]() { return (queued) || (stopping); });
+        if ((stopping) && (!queued))
+            return;
+    }
+}
+
+} // namespace tfc
+
@@ -0,0 +1,182 @@
+/**
+ * @file    parallel.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the worker threads used to process chunks in parallel.
+ */
+
+#if !defined _PARALLEL_H_INCLUDED_
+#define _PARALLEL_H_INCLUDED_
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+
+namespace tfc
+{
+
+
+/**
+ * @section Parallel processing.
+ *
+ */
+
+/**
+ * Run a task for every index from 0 to count-1 on up to jobs threads. The
+ * indices are handed out in order as threads become free, so the caller
+ * need not balance the work. On a WorkPool worker the pool's threads are
+ * used instead of starting new ones.
+ *
+ * @param  count - number of tasks.
+ * @param  jobs - maximum number of threads to use.
+ * @param  task - function called with each index.
+ */
+extern void runParallel(size_t count, size_t jobs, const std::function<void(size_t)> & task);
+
+/**
+ * Run a task for every index from 0 to count-1 on up to jobs threads, each
+ * producing a buffer, and consume the buffers strictly in index order as
+ * soon as they are ready. Only a limited number of buffers are held at
+ * once, so memory use does not grow with count.
+ *
+ * @param  count - number of tasks.
+ * @param  jobs - maximum number of threads to use.
+ * @param  produce - function called with each index and a buffer to fill.
+ * @param  consume - function called with each filled buffer, in order.
+ */
+extern void runOrdered(size_t count, size_t jobs,
+    const std::function<void(size_t, std::vector<char> &)> & produce,
+    const std::function<void(const std::vector<char> &)> & consume);
+
+
+
+/**
+ * @section Work stealing thread pool.
+ *
+ * Each worker has its own queue of tasks. A worker takes the most recently
+ * added task from its own queue and, when that is empty, steals the oldest
+ * task from another queue, so idle workers find work without a single
+ * shared queue becoming a bottleneck. Tasks submitted by threads outside
+ * the pool go on a queue of their own that the workers steal from. When
+ * runParallel() is called on a worker the extra threads are borrowed from
+ * the pool, so a large task can be split further across idle workers.
+ */
+
+class WorkPool
+{
+public:
+    explicit WorkPool(size_t threads);
+    ~WorkPool(void);
+
+//- Delete the copy constructor and assignement operator.
+    WorkPool(const WorkPool &) = delete;
+    void operator=(const WorkPool &) = delete;
+
+    size_t size(void) const { return workers.size(); }
+
+    void submit(std::function<void(void)> task);
+    bool help(void);
+
+    static WorkPool * current(void);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void(void)>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    size_t home(void) const;
+    bool take(size_t index, std::function<void(void)> &task);
+    void work(size_t index);
+};
+
+
+
+/**
+ * @section Single producer single consumer ring.
+ *
+ * A fixed number of slots shared by exactly one thread pushing and one
+ * thread popping, so each index is only ever written by one side and no
+ * lock is needed. A side that finds the ring full or empty waits on the
+ * index the other side moves, rather than spinning, as a block of file
+ * data takes far longer to process than a thread takes to wake.
+ */
+
+template<typename T>
+class Ring
+{
+public:
+    explicit Ring(size_t count) : slots(std::bit_ceil(std::max(count, size_t{1}))), head{}, tail{} {}
+
+//- Delete the copy constructor and assignement operator.
+    Ring(const Ring &) = delete;
+    void operator=(const Ring &) = delete;
+
+    void push(T item)
+    {
+        const size_t index{tail.load(std::memory_order_relaxed)};
+        for (size_t first{head.load(std::memory_order_acquire)}; index - first == slots.size(); first = head.load(std::memory_order_acquire))
+            head.wait(first, std::memory_order_acquire);
+
+        slots[index & (slots.size() - 1)] = std::move(item);
+        tail.store(index + 1, std::memory_order_release);
+        tail.notify_one();
+    }
+
+    T pop(void)
+    {
+        const size_t index{head.load(std::memory_order_relaxed)};
+        while (tail.load(std::memory_order_acquire) == index)
+            tail.wait(index, std::memory_order_acquire);
+
+        T item{std::move(slots[index & (slots.size() - 1)])};
+        head.store(index + 1, std::memory_order_release);
+        head.notify_one();
+
+        return item;
+    }
+
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+} // namespace tfc
+
+
+#endif //!defined _PARALLEL_H_INCLUDED_
+
@@ -0,0 +1,100 @@
+/**
+ * @file    pipe.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the streaming of standard input and output through pipes.
+ */
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pipe.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Pipe streaming implementation.
+ *
+ */
+
+/**
+ * Grow a pipe to hold a whole block. This is best effort: the size is
+ * capped by /proc/sys/fs/pipe-max-size for unprivileged users, and a pipe
+ * that cannot grow still works, just with smaller reads and writes.
+ *
+ * @param  fd - the file descriptor, which is left alone if not a pipe.
+ * @param  size - the size wanted.
+ */
+void growPipe(int fd, size_t size)
+{
+    struct stat info{};
+    if ((::fstat(fd, &info) != 0) || (!S_ISFIFO(info.st_mode)))
+        return;
+
+    const int current{::fcntl(fd, F_GETPIPE_SZ)};
+    if ((current >= 0) && (static_cast<size_t>(current) < size))
+        ::fcntl(fd, F_SETPIPE_SZ, static_cast<int>(size));
+}
+
+/**
+ * Write characters straight to the file descriptor.
+ *
+ * @param  s - pointer to the first character to write.
+ * @param  count - number of characters to write.
+ * @return the number of characters written, short on error.
+ */
+std::streamsize DescriptorBuffer::xsputn(const char *s, std::streamsize count)
+{
+    std::streamsize written{};
+    while (written < count)
+    {
+        const ssize_t length{::write(fd, s + written, count - written)};
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        written += length;
+    }
+
+    return written;
+}
+
+DescriptorBuffer::int_type DescriptorBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    const char event{traits_type::to_char_type(c)};
+
+    return xsputn(&event, 1) == 1 ? c : traits_type::eof();
+}
+
+} // namespace tfc
+
@@ -0,0 +1,65 @@
+/**
+ * @file    pipe.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the streaming of standard input and output through pipes.
+ */
+
+#if !defined _PIPE_H_INCLUDED_
+#define _PIPE_H_INCLUDED_
+
+#include <streambuf>
+#include <cstddef>
+
+namespace tfc
+{
+
+
+/**
+ * @section Pipe streaming.
+ *
+ * A pipe holds 64 KiB by default, so a filter reading from or writing to
+ * one is woken for every 64 KiB however big its blocks are. Growing the
+ * pipe to the block size lets each read and write move a whole block when
+ * the other end keeps up. Output to a file descriptor bypasses the buffering
+ * of std::cout, as the blocks written are already large.
+ */
+
+extern void growPipe(int fd, size_t size);
+
+class DescriptorBuffer : public std::streambuf
+{
+public:
+    explicit DescriptorBuffer(int descriptor) : fd{descriptor} {}
+
+protected:
+    std::streamsize xsputn(const char *s, std::streamsize count) override;
+    int_type overflow(int_type c) override;
+
+private:
+    int fd;
+};
+
+} // namespace tfc
+
+
+#endif //!defined _PIPE_H_INCLUDED_
+
@@ -0,0 +1,181 @@
+/**
+ * @file    pipeline.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the reader, transform and writer pipeline.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "pipeline.h"
+#include "parallel.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Reader, transform and writer pipeline implementation.
+ *
+ */
+
+//- A block of input, and the buffer it was read into, to be recycled.
+struct Block
+{
+    std::span<char> buffer;
+    std::span<const char> data;
+};
+
+/**
+ * Touch every page of a block of the mapping, so that it is paged in by
+ * the reader rather than by the transform.
+ *
+ * @param  data - the block of the mapping.
+ */
+static void touch(std::span<const char> data)
+{
+    volatile char sink{};
+    for (size_t i{}; i < data.size(); i += Input::alignment)
+        sink = data[i];
+
+    (void)sink;
+}
+
+/**
+ * Read the input file on a thread of its own, count blocks of the input's
+ * block size ahead of the consumer, which runs on the calling thread. The
+ * reader stops at the end of the file or on an error, which is reported
+ * once the consumer has finished.
+ *
+ * @param  is - the input file.
+ * @param  count - number of blocks in flight.
+ * @param  consume - called with each block of input, in order.
+ * @return error value or 0 if no errors.
+ */
+int runReader(Input &is, size_t count, const Consumer &consume)
+{
+    count = std::max(count, size_t{2});
+    const size_t size{is.getBlockSize()};
+    const size_t inputs{is.isMapped() ? 0 : count};
+    std::unique_ptr<char, decltype(&std::free)> memory{
+        static_cast<char *>(std::aligned_alloc(Input::alignment, std::max(inputs * size, Input::alignment))), &std::free};
+    if (!memory)
+    {
+        std::cerr << "Unable to allocate the pipeline\n";
+
+        return 1;
+    }
+
+    Ring<std::span<char>> empty{count};
+    Ring<Block> full{count};
+    for (size_t i{}; i < count; ++i)
+        empty.push(i < inputs ? std::span<char>{memory.get() + i * size, size} : std::span<char>{});
+
+    std::thread reader{[&]()
+    {
+        for (;;)
+        {
+            const std::span<char> buffer{empty.pop()};
+            const std::span<const char> data{is.read(buffer)};
+            if (is.isMapped())
+                touch(data);
+
+            full.push({ buffer, data });
+            if (data.empty())
+                return;
+        }
+    }};
+
+    for (Block block{full.pop()}; !block.data.empty(); block = full.pop())
+    {
+        consume(block.data);
+        empty.push(block.buffer);
+    }
+
+    reader.join();
+
+    if (is.isError())
+    {
+        std::cerr << "Error reading file " << is.getPath() << '\n';
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Transform the input file to the stream through a pipeline of count
+ * blocks each for the input and the output, of the input's block size.
+ * A stream error is left for the caller to check, as with a direct write.
+ *
+ * @param  is - the input file.
+ * @param  os - output stream for the transformed data.
+ * @param  count - number of blocks in flight between each pair of stages.
+ * @param  stage - called with each block of input, in order.
+ * @return error value or 0 if no errors.
+ */
+int runPipeline(Input &is, std::ostream &os, size_t count, const Stage &stage)
+{
+    count = std::max(count, size_t{2});
+    const size_t size{is.getBlockSize()};
+    std::unique_ptr<char, decltype(&std::free)> memory{
+        static_cast<char *>(std::aligned_alloc(Input::alignment, count * size)), &std::free};
+    if (!memory)
+    {
+        std::cerr << "Unable to allocate the pipeline\n";
+
+        return 1;
+    }
+
+    Ring<std::span<char>> empty{count};
+    Ring<std::span<char>> full{count};
+    for (size_t i{}; i < count; ++i)
+        empty.push({ memory.get() + i * size, size });
+
+    std::thread writer{[&]()
+    {
+        for (std::span<char> block{full.pop()}; !block.empty(); block = full.pop())
+        {
+            os.write(block.data(), block.size());
+            empty.push({ block.data(), size });
+        }
+    }};
+
+    int ret{};
+    {
+        Output out{[&](std::span<char> block) { full.push(block); return empty.pop(); }, empty.pop()};
+        ret = runReader(is, count, [&](std::span<const char> block) { stage(block, out); });
+        out.flush();
+    }
+
+    full.push({});
+    writer.join();
+
+    return ret;
+}
+
+} // namespace tfc
+
@@ -0,0 +1,69 @@
+/**
+ * @file    pipeline.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the reader, transform and writer pipeline.
+ */
+
+#if !defined _PIPELINE_H_INCLUDED_
+#define _PIPELINE_H_INCLUDED_
+
+#include <functional>
+#include <ostream>
+#include <span>
+
+#include "input.h"
+#include "output.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Reader, transform and writer pipeline.
+ *
+ * A reader thread fills block N+1 while the calling thread transforms block
+ * N and a writer thread writes out block N-1, so a single large file keeps
+ * the disk, a core and the output busy at once. The blocks are handed from
+ * stage to stage through Rings and recycled, so no memory is allocated once
+ * the pipeline is running. Mapped input is not copied: the reader touches
+ * the pages of each block instead, so the transform does not wait on page
+ * faults. The reader may also be used on its own, to read ahead of a
+ * consumer that produces no output.
+ */
+
+//- Smaller files are over before the threads have started.
+static constexpr size_t minPipelineSize{4 * 1024 * 1024};
+
+//- Consumes a block of input, in order.
+using Consumer = std::function<void(std::span<const char> block)>;
+
+//- Transforms a block of input into the output, in order.
+using Stage = std::function<void(std::span<const char> block, Output &out)>;
+
+extern int runReader(Input &is, size_t count, const Consumer &consume);
+extern int runPipeline(Input &is, std::ostream &os, size_t count, const Stage &stage);
+
+} // namespace tfc
+
+
+#endif //!defined _PIPELINE_H_INCLUDED_
+
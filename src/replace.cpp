@@ -0,0 +1,365 @@
+/**
+ * @file    replace.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the atomic replacement of a file.
+ */
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "replace.h"
+
+
+/**
+ * @section Atomic file replacement implementation.
+ *
+ */
+
+/**
+ * @return the mode a file would have if it had been opened for writing. The
+ * umask can only be read by changing it, so this is only called once, before
+ * any threads are started.
+ */
+static mode_t readCreateMode(void)
+{
+    const mode_t mask{::umask(0)};
+    ::umask(mask);
+
+    return (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) & ~mask;
+}
+
+static const mode_t createMode{readCreateMode()};
+
+mode_t Replacement::getCreateMode(void)
+{
+    return createMode;
+}
+
+/**
+ * Create the temporary file alongside the file to be replaced. A symbolic
+ * link is followed so that the file it refers to is replaced, not the link.
+ * A file that does not exist yet is created as if opened for writing.
+ *
+ * @param  file - path of the file to be replaced.
+ */
+Replacement::Replacement(const std::filesystem::path & file) :
+    target{file}, temp{}, fd{-1}
+{
+    std::error_code ec{};
+    if (std::filesystem::is_symlink(file, ec))
+    {
+        const auto resolved{std::filesystem::canonical(file, ec)};
+        if (!ec)
+            target = resolved;
+    }
+
+    std::string name{target.parent_path() / ("." + target.filename().string() + ".tfc-XXXXXX")};
+    fd = mkostemp(name.data(), O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    temp = name;
+
+    struct stat info{};
+    if (::stat(target.c_str(), &info) == 0)
+    {
+        if (fchown(fd, info.st_uid, info.st_gid) != 0)
+            std::cerr << "Unable to preserve the ownership of file " << target << '\n';
+
+        if (fchmod(fd, info.st_mode & 07777) != 0)
+            std::cerr << "Unable to preserve the mode of file " << target << '\n';
+    }
+    else
+    if (fchmod(fd, createMode) != 0)
+    {
+        std::cerr << "Unable to set the mode of file " << target << '\n';
+    }
+}
+
+Replacement::~Replacement(void)
+{
+    discard();
+}
+
+/**
+ * Remove the temporary file if it has not been committed.
+ */
+void Replacement::discard(void)
+{
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+
+    if (!temp.empty())
+    {
+        std::error_code ec{};
+        std::filesystem::remove(temp, ec);
+        temp.clear();
+    }
+}
+
+/**
+ * Give the file a mode of its own rather than that of the file replaced.
+ *
+ * @param  mode - the permission bits of the file.
+ * @return true if the mode was set.
+ */
+bool Replacement::setMode(mode_t mode)
+{
+    return fchmod(fd, mode) == 0;
+}
+
+/**
+ * Append characters to the temporary file.
+ *
+ * @param  first - pointer to the first character to write.
+ * @param  length - number of characters to write.
+ * @return true if all the characters were written.
+ */
+bool Replacement::write(const char *first, size_t length)
+{
+    while (length)
+    {
+        const ssize_t count{::write(fd, first, length)};
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        first += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+/**
+ * Append the start of another file to the temporary file without passing
+ * the data through user space. File systems that support it share the
+ * blocks instead of copying them.
+ *
+ * @param  from - descriptor of the file to copy from.
+ * @param  length - number of bytes to copy from the start of the file.
+ * @return number of bytes copied, which is less than requested if the file
+ *         systems do not support copying between them.
+ */
+size_t Replacement::copy(int from, size_t length)
+{
+    loff_t position{};
+    while (static_cast<size_t>(position) < length)
+    {
+        const ssize_t count{copy_file_range(from, &position, fd, nullptr, length - position, 0)};
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (count == 0)
+            break;
+    }
+
+    return position;
+}
+
+/**
+ * Move the new contents into place.
+ *
+ * @param  sync - flush the data to disk before renaming and the directory
+ *                after.
+ * @return error value or 0 if no errors.
+ */
+int Replacement::commit(bool sync)
+{
+    if ((sync) && (fsync(fd) != 0))
+    {
+        std::cerr << "Failed to sync file " << temp << '\n';
+        discard();
+
+        return 1;
+    }
+
+    ::close(fd);
+    fd = -1;
+
+    if (std::rename(temp.c_str(), target.c_str()) != 0)
+    {
+        std::cerr << "Failed to rename file " << temp << " to " << target << '\n';
+        discard();
+
+        return 1;
+    }
+
+    temp.clear();
+
+    if (sync)
+    {
+        const auto directory{target.has_parent_path() ? target.parent_path() : std::filesystem::path{"."}};
+        const int dir{::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+        if (dir >= 0)
+        {
+            fsync(dir);
+            ::close(dir);
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @section Lazy file replacement implementation.
+ *
+ */
+
+/**
+ * @param  file - path of the file that may be replaced.
+ * @param  contents - the current contents of the file.
+ */
+LazyReplacement::LazyReplacement(const std::filesystem::path & path, std::span<const char> contents) :
+    file{path}, original{contents}, offset{}, replacement{}, rewritten{}, failed{}
+{
+}
+
+/**
+ * Start the replacement, copying across the prefix that has been found to
+ * match. The kernel copies what it can and the rest comes from the
+ * original contents.
+ *
+ * @return true if the replacement is ready for the rest of the output.
+ */
+bool LazyReplacement::diverge(void)
+{
+    rewritten = true;
+    replacement = std::make_unique<Replacement>(file);
+    if (!replacement->is_open())
+    {
+        std::cerr << "Failed to create a temporary file for " << file << '\n';
+
+        return false;
+    }
+
+    size_t copied{};
+    const int from{::open(file.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (from >= 0)
+    {
+        copied = replacement->copy(from, offset);
+        ::close(from);
+    }
+
+    if (!replacement->write(original.data() + copied, offset - copied))
+    {
+        std::cerr << "Failed to write file " << file << '\n';
+
+        return false;
+    }
+
+    return true;
+}
+
+std::streamsize LazyReplacement::xsputn(const char *first, std::streamsize length)
+{
+    if (failed)
+        return 0;
+
+    const size_t count(length);
+    if (!replacement)
+    {
+        const size_t available{std::min(count, original.size() - offset)};
+        const auto match{std::mismatch(first, first + available, original.data() + offset)};
+        const size_t same(match.first - first);
+        offset += same;
+
+        if (same == count)
+            return length;
+
+        if (!diverge())
+        {
+            failed = true;
+
+            return 0;
+        }
+
+        first += same;
+        length -= same;
+    }
+
+    if (!replacement->write(first, length))
+    {
+        std::cerr << "Failed to write file " << file << '\n';
+        failed = true;
+
+        return 0;
+    }
+
+    offset += length;
+
+    return count;
+}
+
+std::streambuf::int_type LazyReplacement::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    const char event{traits_type::to_char_type(c)};
+
+    return xsputn(&event, 1) == 1 ? c : traits_type::eof();
+}
+
+/**
+ * Finish the output. The file is only replaced if the output differs from
+ * the original, which includes being shorter.
+ *
+ * @param  sync - flush the data to disk before renaming.
+ * @return error value or 0 if no errors.
+ */
+int LazyReplacement::commit(bool sync)
+{
+    if (failed)
+        return 1;
+
+    if (!replacement)
+    {
+        if (offset == original.size())
+            return 0;
+
+        if (!diverge())
+            return 1;
+    }
+
+    return replacement->commit(sync);
+}
+
@@ -0,0 +1,113 @@
+/**
+ * @file    replace.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the atomic replacement of a file.
+ */
+
+#if !defined _REPLACE_H_INCLUDED_
+#define _REPLACE_H_INCLUDED_
+
+#include <filesystem>
+#include <streambuf>
+#include <memory>
+#include <span>
+
+#include <sys/types.h>
+
+
+/**
+ * @section Atomic file replacement.
+ *
+ * The new contents are written to a uniquely named temporary file in the
+ * same directory as the file being replaced, given the same mode and
+ * ownership, then renamed over it. Readers see either the old or the new
+ * contents, never a mixture, the data is only written once and concurrent
+ * runs cannot collide. The temporary file is removed unless committed.
+ */
+
+class Replacement
+{
+public:
+    explicit Replacement(const std::filesystem::path & file);
+    ~Replacement(void);
+
+//- Delete the copy constructor and assignement operator.
+    Replacement(const Replacement &) = delete;
+    void operator=(const Replacement &) = delete;
+
+    bool is_open(void) const { return fd >= 0; }
+    const std::filesystem::path & getTarget(void) const { return target; }
+
+    bool setMode(mode_t mode);
+    bool write(const char *first, size_t length);
+    size_t copy(int from, size_t length);
+    int commit(bool sync);
+
+    static mode_t getCreateMode(void);
+
+private:
+    std::filesystem::path target;
+    std::filesystem::path temp;
+    int fd;
+
+    void discard(void);
+};
+
+
+/**
+ * @section Lazy file replacement.
+ *
+ * The output is compared with the original contents as it is produced and
+ * nothing is written while they match. At the first difference the
+ * replacement is created, the matching prefix is copied across by the
+ * kernel and the output continues from there. A file that needs no change
+ * is left completely untouched, including its modification time.
+ */
+
+class LazyReplacement : public std::streambuf
+{
+public:
+    LazyReplacement(const std::filesystem::path & file, std::span<const char> contents);
+
+    bool isRewritten(void) const { return rewritten; }
+    size_t getBytesWritten(void) const { return rewritten ? offset : 0; }
+
+    int commit(bool sync);
+
+protected:
+    std::streamsize xsputn(const char *first, std::streamsize length) override;
+    int_type overflow(int_type c) override;
+
+private:
+    std::filesystem::path file;
+    std::span<const char> original;
+    size_t offset;
+    std::unique_ptr<Replacement> replacement;
+    bool rewritten;
+    bool failed;
+
+    bool diverge(void);
+};
+
+
+#endif //!defined _REPLACE_H_INCLUDED_
+
@@ -0,0 +1,809 @@
+/**
+ * @file    state.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the summary state machine.
+ */
+
+#include <iostream>
+#include <array>
+#include <algorithm>
+#include <vector>
+
+#include "state.h"
+#include "input.h"
+#include "kernel.h"
+#include "parallel.h"
+#include "pipeline.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Internal constants and variables.
+ *
+ */
+
+static void streamValue(std::ostream &os, const std::string & label, int value)
+{
+    if (value == 0)
+    {
+        return;
+    }
+
+    os << "  ";
+
+	std::string valStr{std::to_string(value)};
+    const size_t width{label.length() + valStr.length()};
+    std::string padding(width < 18 ? 18 - width : 0, ' ');
+    os << label << ":" << padding << valStr;
+
+    os << "\n";
+}
+
+void State::displaySummary(std::ostream &os, const std::string & title)
+{
+    os << title << '\n';
+    streamValue(os, "Total Lines", lines);
+
+    os << "Line beginning:\n";
+    streamValue(os, "Space only", spOnly);
+    streamValue(os, "Tab only", tabOnly);
+    streamValue(os, "Neither", neither);
+    streamValue(os, "Both", both);
+
+    os << "Line ending:\n";
+    streamValue(os, "Dos", dosEOL);
+    streamValue(os, "Unix", unixEOL);
+    streamValue(os, "Malformed", malformed);
+
+    if (ansi || utf8)
+    {
+        os << "Character encoding:\n";
+        streamValue(os, "ANSI", ansi);
+        streamValue(os, "UTF-8", utf8);
+    }
+
+    os << '\n';
+}
+
+void State::displayDebug(std::ostream &os, const std::string & title)
+{
+    os << title << '\n';
+    os << lines;
+    os << " " << spOnly;
+    os << " " << tabOnly;
+    os << " " << neither;
+    os << " " << both;
+    os << " " << dosEOL;
+    os << " " << unixEOL;
+    os << " " << malformed;
+    os << '\n';
+}
+
+void State::display(std::ostream &os, const std::string & title, bool debug)
+{
+    if (debug)
+        displayDebug(os, title);
+    else
+        displaySummary(os, title);
+}
+
+/**
+ * Add the counts of another file, for a total over many files.
+ *
+ * @param  other - summary of the other file.
+ */
+State & State::operator+=(const State &other)
+{
+    lines += other.lines;
+    neither += other.neither;
+    spOnly += other.spOnly;
+    tabOnly += other.tabOnly;
+    both += other.both;
+    malformed += other.malformed;
+    dosEOL += other.dosEOL;
+    unixEOL += other.unixEOL;
+    ansi += other.ansi;
+    utf8 += other.utf8;
+
+    return *this;
+}
+
+/**
+ * Restore the counts of a file, such as from the cache.
+ *
+ * @param  summary - the counts as returned by getSummary().
+ */
+State::State(const tfc::Summary &summary) :
+    lines{summary.lines}, neither{summary.neither}, spOnly{summary.spOnly}, tabOnly{summary.tabOnly},
+    both{summary.both}, malformed{summary.malformed}, dosEOL{summary.dosEOL}, unixEOL{summary.unixEOL},
+    ansi{summary.ansi}, utf8{summary.utf8}
+{
+}
+
+/**
+ * @return the counts for the file.
+ */
+tfc::Summary State::getSummary(void) const
+{
+    return { lines, neither, spOnly, tabOnly, both, malformed, dosEOL, unixEOL, ansi, utf8 };
+}
+
+void State::processTab(void)
+{
+    if (start)
+        tab = true;
+
+    lf = false;
+    cr = false;
+}
+
+void State::processSpace(void)
+{
+    if (start)
+        space = true;
+
+    lf = false;
+    cr = false;
+}
+
+void State::processLineFeed(void)
+{
+    if (cr)
+        ++dosEOL;
+    else
+    {
+        ++unixEOL;
+        lf = true;
+    }
+
+    ++lines;
+
+    if (tab)
+    {
+        if (space)
+            ++both;
+        else
+            ++tabOnly;
+    }
+    else
+    {
+        if (space)
+            ++spOnly;
+        else
+            ++neither;
+    }
+
+    tab = false;
+    space = false;
+    start = true;
+    cr = false;
+}
+
+void State::processCarriageReturn(void)
+{
+    if (lf)
+    {
+        ++malformed;
+        --unixEOL;		// Was counted as unix, but shouldn't be.
+        cr = false;
+    }
+    else
+        cr = true;
+
+    lf = false;
+}
+
+/**
+ * @section UTF-8 sequence tracking.
+ *
+ * Only non-ASCII bytes take part. The number of bytes the current sequence
+ * needs and the number processed so far are combined into a single state
+ * so that each byte costs one lookup in a table generated at compile time.
+ */
+
+static constexpr int numUtf8Bytes(unsigned char lead)
+{
+    if ((lead & 0x80) == 0x0)   return 1;
+    if ((lead & 0xE0) == 0xC0)  return 2;
+    if ((lead & 0xF0) == 0xE0)  return 3;
+    if ((lead & 0xF8) == 0xF0)  return 4;
+
+    return 0;
+}
+
+static constexpr bool isUtf8ContinuationByte(unsigned char byte)
+{
+    return ((byte & 0xC0) == 0x80);
+}
+
+static constexpr int utf8StateIndex(int needed, int processed)
+{
+    return needed ? ((needed - 2) * (needed - 1) / 2) + processed : 0;
+}
+
+struct Utf8Step
+{
+    unsigned char next;
+    unsigned char ansi;
+    unsigned char utf8;
+};
+
+using Utf8Table = std::array<std::array<Utf8Step, 128>, 7>;
+
+static constexpr Utf8Table makeUtf8Table(void)
+{
+    Utf8Table table{};
+
+    for (int needed : { 0, 2, 3, 4 })
+    {
+        for (int processed{needed ? 1 : 0}; processed < std::max(needed, 1); ++processed)
+        {
+            for (int byte{0x80}; byte <= 0xFF; ++byte)
+            {
+                int n{needed};
+                int p{processed};
+                Utf8Step step{};
+
+                if (n)
+                {
+                    if (isUtf8ContinuationByte(byte))
+                    {
+                        if (++p == n)
+                        {
+                            step.utf8 = 1;
+                            n = 0;
+                        }
+                    }
+                    else
+                    {
+                        step.ansi = p;
+                        n = 0;
+                    }
+                }
+                else
+                {
+                    n = numUtf8Bytes(byte);
+                    p = 1;
+                    if (!n)
+                        step.ansi = 1;
+                }
+
+                step.next = utf8StateIndex(n, p);
+                table[utf8StateIndex(needed, processed)][byte - 0x80] = step;
+            }
+        }
+    }
+
+    return table;
+}
+
+static constexpr Utf8Table utf8Table{makeUtf8Table()};
+
+static constexpr size_t minChunkSize{1024 * 1024};
+
+static bool isUtf8Sequence(const char *first, const char *last)
+{
+    return (last - first >= 2) && (numUtf8Bytes(first[0]) > 1) && (isUtf8ContinuationByte(first[1]));
+}
+
+void State::processAllOther(unsigned char event)
+{
+    start = false;
+    lf = false;
+    cr = false;
+
+    if (event > 0x7F)
+    {
+        const Utf8Step & step{utf8Table[utf8State][event - 0x80]};
+        utf8State = step.next;
+        ansi += step.ansi;
+        utf8 += step.utf8;
+    }
+}
+
+void State::processEvent(char event)
+{
+    switch (event)
+    {
+    case '\t':  processTab();               break;
+    case ' ':   processSpace();             break;
+
+    case '\n':  processLineFeed();          break;
+    case '\r':  processCarriageReturn();    break;
+
+    default:    processAllOther(event);
+    }
+}
+
+/**
+ * Process a block of the input. Only the leading whitespace of each line
+ * is examined a byte at a time. After that the rest of the line is skipped
+ * with the vectorised kernel up to the next line ending or non-ASCII byte,
+ * as every other byte has the same effect: neither line ending flag is set.
+ * Runs of complete UTF-8 sequences are then counted in bulk, leaving only
+ * ISO-8859-1 and malformed bytes for the table.
+ *
+ * @param  block - contiguous range of input bytes.
+ */
+void State::process(std::span<const char> block)
+{
+    const char *first{block.data()};
+    const char * const last{first + block.size()};
+
+    while (first != last)
+    {
+        if (!start)
+        {
+            const char *next{findLineEvent(first, last)};
+            if (next != first)
+            {
+                lf = false;
+                cr = false;
+                first = next;
+
+                if (first == last)
+                    break;
+            }
+
+            if ((!utf8State) && (isUtf8Sequence(first, last)))
+            {
+                const auto run{scanUtf8(first, last)};
+                if (run.length)
+                {
+                    lf = false;
+                    cr = false;
+                    utf8 += run.sequences;
+                    first += run.length;
+
+                    continue;
+                }
+            }
+        }
+
+        processEvent(*first++);
+    }
+}
+
+/**
+ * Summarise the input file and display the summary. A mapped file is split
+ * across the worker threads if there are any. A large file read straight
+ * from the disk is read ahead on a thread of its own, as the kernel only
+ * reads ahead of reads through the page cache.
+ *
+ * @param  os - output stream for the summary.
+ * @param  is - the input file.
+ * @param  job - the number of threads and of read ahead blocks to use.
+ * @return error value or 0 if no errors.
+ */
+int State::process(std::ostream &os, Input &is, const Job &job)
+{
+    if ((job.jobs > 1) && (is.isMapped()))
+    {
+        processParallel(is.getMapping(), job.jobs);
+    }
+    else
+    if ((job.buffers > 1) && (is.isDirect()) && (is.getSize() >= minPipelineSize))
+    {
+        if (runReader(is, job.buffers, [this](std::span<const char> block) { process(block); }))
+            return 1;
+    }
+    else
+    {
+        for (auto block{is.read()}; !block.empty(); block = is.read())
+        {
+            process(block);
+        }
+
+        if (is.isError())
+        {
+            std::cerr << "Error reading file " << is.getPath() << '\n';
+
+            return 1;
+        }
+    }
+
+    display(os, is.getPath().string(), job.options.debug);
+
+    return 0;
+}
+
+/**
+ * @section Mergeable partial summaries.
+ *
+ * A chunk from the middle of a file is summarised without knowing the state
+ * at its start. The line beginning flags, the line ending tracker and the
+ * UTF-8 tracker do not affect each other, so a Partial records:
+ *   - the counts that do not depend on the starting state,
+ *   - the line beginning flags of the partial first and last lines, the
+ *     first line only being classified when the chunk is merged,
+ *   - for every line ending tracker state, the counts and final state,
+ *   - for every UTF-8 tracker state, the counts and final state.
+ * Merging composes these, which is associative, so chunks can be summarised
+ * on any thread and then combined in file order.
+ */
+
+class Partial
+{
+public:
+    Partial(void);
+    explicit Partial(std::span<const char> chunk);
+
+    Partial & operator+=(const Partial &next);
+
+private:
+    friend class State;
+
+    struct Line { bool start; bool space; bool tab; };
+    struct Eol { int dosEOL; int unixEOL; int malformed; unsigned char end; };
+    struct Utf8 { int ansi; int utf8; unsigned char end; };
+
+    enum { none, crReceived, lfReceived, eolStates };
+    static constexpr int utf8States{std::tuple_size<Utf8Table>::value};
+
+    int lines;
+    int neither;
+    int spOnly;
+    int tabOnly;
+    int both;
+    bool closed;
+    Line head;
+    Line tail;
+    std::array<Eol, eolStates> eol;
+    std::array<Utf8, utf8States> utf8;
+
+    static Line combine(const Line &line, const Line &next);
+    static unsigned char eolStep(unsigned char state, char event, Eol &counts);
+    static unsigned char utf8Step(unsigned char state, unsigned char event, Utf8 &counts);
+
+    void count(const Line &line, int delta);
+    void probeHead(std::span<const char> chunk);
+    void probeEol(std::span<const char> chunk);
+    void probeUtf8(std::span<const char> chunk);
+};
+
+/**
+ * Construct the identity, which leaves any Partial unchanged when merged.
+ */
+Partial::Partial(void) :
+    lines{}, neither{}, spOnly{}, tabOnly{}, both{}, closed{},
+    head{true, false, false}, tail{true, false, false}, eol{}, utf8{}
+{
+    for (int i{}; i < eolStates; ++i)
+        eol[i].end = i;
+
+    for (int i{}; i < utf8States; ++i)
+        utf8[i].end = i;
+}
+
+/**
+ * Summarise a chunk with the normal State, then probe the start of the chunk
+ * to see how it would have behaved from the other possible states.
+ *
+ * @param  chunk - contiguous range of input bytes.
+ */
+Partial::Partial(std::span<const char> chunk) : Partial{}
+{
+    State state{};
+    state.process(chunk);
+
+    lines = state.lines;
+    neither = state.neither;
+    spOnly = state.spOnly;
+    tabOnly = state.tabOnly;
+    both = state.both;
+    closed = state.lines != 0;
+
+    probeHead(chunk);
+    if (closed)
+    {
+        count(head, -1);
+        tail = { state.start, state.space, state.tab };
+    }
+    else
+    {
+        tail = head;
+    }
+
+    const unsigned char eolEnd = state.cr ? crReceived : state.lf ? lfReceived : none;
+    eol[none] = { state.dosEOL, state.unixEOL, state.malformed, eolEnd };
+    probeEol(chunk);
+
+    utf8[0] = { state.ansi, state.utf8, state.utf8State };
+    probeUtf8(chunk);
+}
+
+/**
+ * Merge the summary of the chunk that immediately follows this one.
+ *
+ * @param  next - summary of the following chunk.
+ * @return this summary, now covering both chunks.
+ */
+Partial & Partial::operator+=(const Partial &next)
+{
+    lines += next.lines;
+    neither += next.neither;
+    spOnly += next.spOnly;
+    tabOnly += next.tabOnly;
+    both += next.both;
+
+    if (closed)
+    {
+        const Line line{combine(tail, next.head)};
+        if (next.closed)
+        {
+            count(line, 1);
+            tail = next.tail;
+        }
+        else
+        {
+            tail = line;
+        }
+    }
+    else
+    {
+        head = combine(head, next.head);
+        closed = next.closed;
+        tail = closed ? next.tail : head;
+    }
+
+    for (auto & counts : eol)
+    {
+        const Eol & more{next.eol[counts.end]};
+        counts = { counts.dosEOL + more.dosEOL, counts.unixEOL + more.unixEOL, counts.malformed + more.malformed, more.end };
+    }
+
+    for (auto & counts : utf8)
+    {
+        const Utf8 & more{next.utf8[counts.end]};
+        counts = { counts.ansi + more.ansi, counts.utf8 + more.utf8, more.end };
+    }
+
+    return *this;
+}
+
+/**
+ * Combine the line beginning flags of a partial line with those of its
+ * continuation. Once a line has something other than whitespace the
+ * continuation has no effect.
+ */
+Partial::Line Partial::combine(const Line &line, const Line &next)
+{
+    if (!line.start)
+        return line;
+
+    return { next.start, line.space || next.space, line.tab || next.tab };
+}
+
+/**
+ * Follow State::processLineFeed() and State::processCarriageReturn() for
+ * the line ending tracker alone.
+ */
+unsigned char Partial::eolStep(unsigned char state, char event, Eol &counts)
+{
+    switch (event)
+    {
+    case '\n':
+        if (state == crReceived)
+        {
+            ++counts.dosEOL;
+
+            return none;
+        }
+
+        ++counts.unixEOL;
+
+        return lfReceived;
+
+    case '\r':
+        if (state == lfReceived)
+        {
+            ++counts.malformed;
+            --counts.unixEOL;
+
+            return none;
+        }
+
+        return crReceived;
+    }
+
+    return none;
+}
+
+unsigned char Partial::utf8Step(unsigned char state, unsigned char event, Utf8 &counts)
+{
+    const Utf8Step & step{utf8Table[state][event - 0x80]};
+    counts.ansi += step.ansi;
+    counts.utf8 += step.utf8;
+
+    return step.next;
+}
+
+void Partial::count(const Line &line, int delta)
+{
+    if (line.tab)
+    {
+        if (line.space)
+            both += delta;
+        else
+            tabOnly += delta;
+    }
+    else
+    {
+        if (line.space)
+            spOnly += delta;
+        else
+            neither += delta;
+    }
+}
+
+/**
+ * Find the line beginning flags of the partial first line.
+ */
+void Partial::probeHead(std::span<const char> chunk)
+{
+    for (const char event : chunk)
+    {
+        if ((event == '\n') || (!head.start))
+            break;
+
+        switch (event)
+        {
+        case ' ':   head.space = true;  break;
+        case '\t':  head.tab = true;    break;
+        case '\r':                      break;
+
+        default:    head.start = false;
+        }
+    }
+}
+
+/**
+ * Run the line ending tracker from each of the other states alongside one
+ * started with nothing received, until they agree. They agree as soon as
+ * anything other than a line ending is seen.
+ */
+void Partial::probeEol(std::span<const char> chunk)
+{
+    for (unsigned char state{crReceived}; state < eolStates; ++state)
+    {
+        Eol other{0, 0, 0, state};
+        Eol reference{0, 0, 0, none};
+
+        for (const char event : chunk)
+        {
+            if (other.end == reference.end)
+                break;
+
+            other.end = eolStep(other.end, event, other);
+            reference.end = eolStep(reference.end, event, reference);
+        }
+
+        const bool agreed{other.end == reference.end};
+        eol[state] = {
+            eol[none].dosEOL + other.dosEOL - reference.dosEOL,
+            eol[none].unixEOL + other.unixEOL - reference.unixEOL,
+            eol[none].malformed + other.malformed - reference.malformed,
+            agreed ? eol[none].end : other.end };
+    }
+}
+
+/**
+ * Run the UTF-8 tracker from each of the other states alongside one started
+ * idle, over the non-ASCII bytes only, until they all agree. This usually
+ * takes no more than a single sequence.
+ */
+void Partial::probeUtf8(std::span<const char> chunk)
+{
+    if ((!utf8[0].ansi) && (!utf8[0].utf8) && (!utf8[0].end))
+        return;     // No non-ASCII bytes, so every state is left unchanged.
+
+    std::array<Utf8, utf8States> other{};
+    std::array<bool, utf8States> agreed{true};
+    for (int i{1}; i < utf8States; ++i)
+        other[i].end = i;
+
+    Utf8 reference{};
+    int remaining{utf8States - 1};
+    const char * const last{chunk.data() + chunk.size()};
+    for (const char *next{findNonAscii(chunk.data(), last)}; (next != last) && (remaining); next = findNonAscii(next + 1, last))
+    {
+        reference.end = utf8Step(reference.end, *next, reference);
+        for (int i{1}; i < utf8States; ++i)
+        {
+            if (agreed[i])
+                continue;
+
+            other[i].end = utf8Step(other[i].end, *next, other[i]);
+            if (other[i].end == reference.end)
+            {
+                agreed[i] = true;
+                --remaining;
+                other[i].ansi -= reference.ansi;
+                other[i].utf8 -= reference.utf8;
+            }
+        }
+    }
+
+    for (int i{1}; i < utf8States; ++i)
+    {
+        if (agreed[i])
+            utf8[i] = { utf8[0].ansi + other[i].ansi, utf8[0].utf8 + other[i].utf8, utf8[0].end };
+        else
+            utf8[i] = other[i];
+    }
+}
+
+/**
+ * Construct a State holding the totals of a Partial that covers a whole
+ * file, which therefore started with nothing received.
+ *
+ * @param  total - summary of the whole file.
+ */
+State::State(const Partial &total)
+{
+    Partial whole{total};
+    if (whole.closed)
+        whole.count(whole.head, 1);
+
+    lines = whole.lines;
+    neither = whole.neither;
+    spOnly = whole.spOnly;
+    tabOnly = whole.tabOnly;
+    both = whole.both;
+
+    dosEOL = whole.eol[Partial::none].dosEOL;
+    unixEOL = whole.eol[Partial::none].unixEOL;
+    malformed = whole.eol[Partial::none].malformed;
+
+    ansi = whole.utf8[0].ansi;
+    utf8 = whole.utf8[0].utf8;
+}
+
+/**
+ * Summarise a mapped file by splitting it into chunks that are summarised
+ * on the worker threads and then merged in order.
+ *
+ * @param  data - the whole file.
+ * @param  jobs - number of worker threads.
+ */
+void State::processParallel(std::span<const char> data, size_t jobs)
+{
+    const size_t chunkSize{std::max(minChunkSize, data.size() / (jobs * 4) + 1)};
+    const size_t count{(data.size() + chunkSize - 1) / chunkSize};
+
+    std::vector<Partial> parts(count);
+    runParallel(count, jobs, [&](size_t i)
+    {
+        parts[i] = Partial{data.subspan(i * chunkSize, std::min(chunkSize, data.size() - (i * chunkSize)))};
+    });
+
+    Partial total{};
+    for (const auto & part : parts)
+        total += part;
+
+    *this = State{total};
+}
+
+} // namespace tfc
+
@@ -0,0 +1,98 @@
+/**
+ * @file    state.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the summary state machine.
+ */
+
+#if !defined _STATE_H_INCLUDED_
+#define _STATE_H_INCLUDED_
+
+#include <ostream>
+#include <string>
+#include <span>
+
+#include "libtfc.h"
+
+namespace tfc
+{
+
+class Input;
+
+
+/**
+ * @section Summary state machine.
+ *
+ * A file is summarised a block at a time, or a mapped file is split into
+ * chunks that are summarised on the worker threads and merged.
+ */
+
+class Partial;
+
+class State
+{
+public:
+    State(void) = default;
+    explicit State(const Partial &total);
+    explicit State(const tfc::Summary &summary);
+
+    tfc::Summary getSummary(void) const;
+
+    int process(std::ostream &os, Input &is, const Job &job);
+    void process(std::span<const char> block);
+    void processParallel(std::span<const char> data, size_t jobs);
+    State & operator+=(const State &other);
+    void display(std::ostream &os, const std::string & title, bool debug);
+
+private:
+    friend class Partial;
+
+    bool start{true};
+    bool space{};
+    bool tab{};
+    bool cr{};
+    bool lf{};
+    int lines{};
+    int neither{};
+    int spOnly{};
+    int tabOnly{};
+    int both{};
+    int malformed{};
+    int dosEOL{};
+    int unixEOL{};
+    int ansi{};
+    int utf8{};
+    unsigned char utf8State{};
+    void processTab(void);
+    void processSpace(void);
+    void processLineFeed(void);
+    void processCarriageReturn(void);
+    void processAllOther(unsigned char event);
+    void processEvent(char event);
+    void displaySummary(std::ostream &os, const std::string & title);
+    void displayDebug(std::ostream &os, const std::string & title);
+};
+
+} // namespace tfc
+
+
+#endif //!defined _STATE_H_INCLUDED_
+
@@ -0,0 +1,598 @@
+/**
+ * @file    status.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the transform state machine.
+ */
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
+#include "status.h"
+#include "input.h"
+#include "output.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "kernel.h"
+
+namespace tfc
+{
+
+
+/**
+ * @section Transform options.
+ *
+ * The options are fixed for a whole file, so Status is specialised for
+ * each combination with the options as compile time constants. The tab
+ * size is always a power of 2, so tab stops become shifts and masks, and
+ * the branches for options that are not in use disappear.
+ */
+
+template<size_t size, Leading leading, Trailing trailing>
+class Status
+{
+public:
+    Status(void) : state{}, column{} {}
+    int process(std::ostream &os, Input &is, const Job &job);
+    void process(std::span<const char> block, Output &out);
+    void resume(std::span<const char> before);
+    static int processParallel(std::ostream &os, std::span<const char> data, size_t jobs);
+
+private:
+    enum class State { start, beginning, middle, end };
+    enum class NLState { start, CR_rec, LF_rec, other };
+    enum Class : unsigned char { blank, htab, cr, lf, other, classes };
+
+    static constexpr size_t states{4 * 4};
+
+    static constexpr bool ignoreHead{leading == Leading::unchanged};
+    static constexpr bool ignoreTail{trailing == Trailing::unchanged};
+    static constexpr bool space{leading == Leading::space};
+    static constexpr bool tab{leading == Leading::tab};
+    static constexpr std::string_view newline{trailing == Trailing::crlf ? "\r\n" : "\n"};
+
+/**
+ * The actions for a transition are performed in the order listed.
+ */
+    enum Action : unsigned char
+    {
+        none        = 0,
+        resetColumn = 1 << 0,
+        nextColumn  = 1 << 1,
+        nextTabStop = 1 << 2,
+        putPadding  = 1 << 3,
+        putEvent    = 1 << 4,
+        putNewline  = 1 << 5,
+    };
+
+    struct Transition
+    {
+        unsigned char next;
+        unsigned char action;
+    };
+
+/**
+ * The next states are packed 4 bits per state into a word for each class,
+ * so finding the next state is a shift and a mask rather than a dependent
+ * load, and the actions are looked up alongside.
+ */
+    struct Table
+    {
+        std::array<uint64_t, classes> next;
+        std::array<std::array<unsigned char, classes>, states> action;
+    };
+
+    static constexpr Transition step(State state, NLState nlState, Class event);
+    static constexpr Table buildTable(void);
+    static constexpr std::array<Class, 256> buildClasses(void);
+
+    static constexpr Table table{buildTable()};
+    static constexpr std::array<Class, 256> classOf{buildClasses()};
+
+    unsigned char state;
+    size_t column;
+
+    static unsigned nextState(unsigned current, Class event) { return (table.next[event] >> (current * 4)) & 0xF; }
+
+    void padding(Output &out) const;
+    void perform(unsigned char action, char event, Output &out);
+    void processLineEnds(std::span<const char> block, Output &out);
+};
+
+/**
+ * @section Utility functions.
+ *
+ */
+
+static constexpr size_t minChunkSize{1024 * 1024};
+
+//- The vectorised search only pays off on runs of text longer than this,
+//- so after a shorter one the next this many characters are stepped through
+//- one at a time before it is tried again.
+static constexpr size_t shortRun{16};
+static constexpr size_t stepLength{128};
+
+template<size_t size, Leading leading, Trailing trailing>
+void Status<size, leading, trailing>::padding(Output &out) const
+{
+    if constexpr (tab)
+    {
+        out.put('\t', column / size);
+        out.put(' ', column % size);
+    }
+    else
+    if constexpr (space)
+    {
+        out.put(' ', column);
+    }
+}
+
+
+/**
+ * @section Fused state machine.
+ *
+ * The whitespace handler, which tracks the leading whitespace of each line,
+ * and the newline handler, which tracks runs of line ending characters, run
+ * in lockstep on every character. They are combined into a single product
+ * automaton whose transitions and output actions are worked out at compile
+ * time, indexed by the fused state and the class of the character.
+ */
+
+/**
+ * Work out one transition of the fused machine from the rules of the two
+ * handlers.
+ *
+ * @param  state - whitespace handler state.
+ * @param  nlState - newline handler state.
+ * @param  event - class of the character being processed.
+ * @return the next fused state and the actions to perform.
+ */
+template<size_t size, Leading leading, Trailing trailing>
+constexpr auto Status<size, leading, trailing>::step(State state, NLState nlState, Class event) -> Transition
+{
+    const bool isNewLine{(event == cr) || (event == lf)};
+    unsigned action{none};
+
+//- Whitespace handler. The start state only differs from the end state in
+//- relying on the initial column, so both reset it.
+    if constexpr (ignoreHead)
+    {
+        if (isNewLine)
+            state = State::end;
+        else
+            action |= putEvent;
+    }
+    else
+    if (isNewLine)
+    {
+        if (state == State::beginning)
+            action |= putPadding;
+
+        state = State::end;
+    }
+    else
+    switch (state)
+    {
+    case State::start:
+    case State::end:
+        if (event == blank)     { state = State::beginning; action |= resetColumn | nextColumn; }
+        else
+        if (event == htab)      { state = State::beginning; action |= resetColumn | nextTabStop; }
+        else                    { state = State::middle;    action |= putEvent; }
+        break;
+
+    case State::beginning:
+        if (event == blank)     { action |= nextColumn; }
+        else
+        if (event == htab)      { action |= nextTabStop; }
+        else                    { state = State::middle;    action |= putPadding | putEvent; }
+        break;
+
+    case State::middle:
+        action |= putEvent;
+        break;
+    }
+
+//- Newline handler.
+    if (ignoreTail && isNewLine)
+    {
+        action |= putEvent;
+    }
+    else
+    switch (nlState)
+    {
+    case NLState::start:
+    case NLState::other:
+        if (event == cr)        { nlState = NLState::CR_rec;  action |= putNewline; }
+        else
+        if (event == lf)        { nlState = NLState::LF_rec;  action |= putNewline; }
+        else                    { nlState = NLState::other; }
+        break;
+
+    case NLState::CR_rec:
+        if (event == cr)        { action |= putNewline; }
+        else                    { nlState = NLState::other; }
+        break;
+
+    case NLState::LF_rec:
+        if (event == lf)        { action |= putNewline; }
+        else                    { nlState = NLState::other; }
+        break;
+    }
+
+    const auto next{static_cast<unsigned>(state) * 4 + static_cast<unsigned>(nlState)};
+
+    return { static_cast<unsigned char>(next), static_cast<unsigned char>(action) };
+}
+
+template<size_t size, Leading leading, Trailing trailing>
+constexpr auto Status<size, leading, trailing>::buildTable(void) -> Table
+{
+    Table fused{};
+    for (size_t i = 0; i < states; ++i)
+        for (size_t c = 0; c < classes; ++c)
+        {
+            const Transition transition{step(State(i / 4), NLState(i % 4), Class(c))};
+            fused.next[c] |= uint64_t{transition.next} << (i * 4);
+            fused.action[i][c] = transition.action;
+        }
+
+    return fused;
+}
+
+template<size_t size, Leading leading, Trailing trailing>
+constexpr auto Status<size, leading, trailing>::buildClasses(void) -> std::array<Class, 256>
+{
+    std::array<Class, 256> result{};
+    for (auto &c : result)
+        c = other;
+
+    result[' '] = blank;
+    result['\t'] = htab;
+    result['\r'] = cr;
+    result['\n'] = lf;
+
+    return result;
+}
+
+template<size_t size, Leading leading, Trailing trailing>
+void Status<size, leading, trailing>::perform(unsigned char action, char event, Output &out)
+{
+    if constexpr (!ignoreHead)
+    {
+        if (action & resetColumn)
+            column = 0;
+
+        if (action & nextColumn)
+            ++column;
+
+        if (action & nextTabStop)
+            column = ((column / size) + 1) * size;
+
+        if (action & putPadding)
+            padding(out);
+    }
+
+    if (action & putEvent)
+        out.put(event);
+
+    if constexpr (!ignoreTail)
+    {
+        if (action & putNewline)
+            out.write(newline.data(), newline.size());
+    }
+}
+
+
+/**
+ * When the leading whitespace is left unchanged only the line endings are
+ * rewritten, so the text between them is found with a vectorised search and
+ * copied in bulk. Only the line ending characters go through the machine.
+ *
+ * @param  block - the characters to process.
+ * @param  out - where the result is written.
+ */
+template<size_t size, Leading leading, Trailing trailing>
+void Status<size, leading, trailing>::processLineEnds(std::span<const char> block, Output &out)
+{
+    unsigned current{state};
+    const char *first{block.data()};
+    const char *const last{first + block.size()};
+    while (first != last)
+    {
+        const char *next{findNewline(first, last)};
+        if (next != first)
+        {
+            out.write(first, next - first);
+            current = nextState(current, other);
+        }
+
+        for (first = next; (first != last) && ((*first == '\n') || (*first == '\r')); ++first)
+        {
+            const Class event{classOf[static_cast<unsigned char>(*first)]};
+            perform(table.action[current][event], *first, out);
+            current = nextState(current, event);
+        }
+    }
+    state = current;
+}
+
+/**
+ * Only the start and the end of each line need the machine. Once the first
+ * character after the indentation has been written, the rest of the line is
+ * found with a vectorised search and copied in bulk, so the cost depends on
+ * the amount of indentation and the number of lines rather than the size of
+ * the file. On short lines the search costs more than it saves, so after a
+ * short run of text the block is stepped through one character at a time
+ * for a while before the search is tried again.
+ *
+ * @param  block - the characters to process.
+ * @param  out - where the result is written.
+ */
+template<size_t size, Leading leading, Trailing trailing>
+void Status<size, leading, trailing>::process(std::span<const char> block, Output &out)
+{
+    if constexpr (ignoreHead)
+    {
+        processLineEnds(block, out);
+
+        return;
+    }
+
+//- The state is kept local as the output could otherwise alias it.
+    unsigned current{state};
+    const char *first{block.data()};
+    const char *const last{first + block.size()};
+    const char *stepped{first};
+    while (first != last)
+    {
+        if ((first >= stepped) && (current / 4 == static_cast<unsigned>(State::middle)))
+        {
+            const char *next{findNewline(first, last)};
+            if (static_cast<size_t>(next - first) < shortRun)
+                stepped = first + std::min(stepLength, static_cast<size_t>(last - first));
+
+            if (next != first)
+            {
+                out.write(first, next - first);
+                current = nextState(current, other);
+                first = next;
+                if (first == last)
+                    break;
+            }
+        }
+
+        const char c{*first++};
+        const Class event{classOf[static_cast<unsigned char>(c)]};
+        const unsigned char action{table.action[current][event]};
+        current = nextState(current, event);
+
+        if (action == putEvent)
+            out.put(c);
+        else
+        if (action != none)
+            perform(action, c, out);
+    }
+    state = current;
+}
+
+/**
+ * Bring the handlers up to date for starting part way through a file, just
+ * after a line feed. Only the line ending characters immediately before that
+ * point can affect the newline handler, so just those are processed and
+ * their output discarded.
+ *
+ * @param  before - everything in the file before the starting point.
+ */
+template<size_t size, Leading leading, Trailing trailing>
+void Status<size, leading, trailing>::resume(std::span<const char> before)
+{
+    auto first{before.end()};
+    while ((first != before.begin()) && ((first[-1] == '\n') || (first[-1] == '\r')))
+        --first;
+
+    std::vector<char> discard{};
+    Output out{discard};
+    process({first, before.end()}, out);
+}
+
+/**
+ * Split the data into chunks that each end just after a line feed, so that
+ * no line is split between chunks.
+ *
+ * @param  data - the whole file.
+ * @param  jobs - number of worker threads.
+ * @return the chunks in file order.
+ */
+static std::vector<std::span<const char>> splitLines(std::span<const char> data, size_t jobs)
+{
+    const size_t chunkSize{std::max(minChunkSize, data.size() / (jobs * 4) + 1)};
+    std::vector<std::span<const char>> chunks{};
+
+    const char * const last{data.data() + data.size()};
+    for (const char *first{data.data()}; first != last; )
+    {
+        const char *split{last};
+        if (size_t(last - first) > chunkSize)
+        {
+            const void *lf{std::memchr(first + chunkSize - 1, '\n', last - (first + chunkSize - 1))};
+            if (lf)
+                split = static_cast<const char *>(lf) + 1;
+        }
+
+        chunks.emplace_back(first, split);
+        first = split;
+    }
+
+    return chunks;
+}
+
+/**
+ * Transform a mapped file by splitting it into chunks of whole lines that
+ * are transformed by their own Status on the worker threads. The output of
+ * each chunk is held until all the chunks before it have been written.
+ *
+ * @param  os - output stream for the transformed file.
+ * @param  data - the whole file.
+ * @param  jobs - number of worker threads.
+ * @return error value or 0 if no errors.
+ */
+template<size_t size, Leading leading, Trailing trailing>
+int Status<size, leading, trailing>::processParallel(std::ostream &os, std::span<const char> data, size_t jobs)
+{
+    const auto chunks{splitLines(data, jobs)};
+
+    auto produce = [&](size_t i, std::vector<char> &buffer)
+    {
+        Status status{};
+        if (i)
+            status.resume({data.data(), chunks[i].data()});
+
+        Output out{buffer};
+        status.process(chunks[i], out);
+        out.flush();
+    };
+
+    auto consume = [&](const std::vector<char> &buffer)
+    {
+        os.write(buffer.data(), buffer.size());
+    };
+
+    runOrdered(chunks.size(), jobs, produce, consume);
+
+    return 0;
+}
+
+/**
+ * Transform the input file to the stream. A mapped file is split across
+ * the worker threads if there are any. Otherwise a large file, or a pipe
+ * of unknown length, is run through a pipeline of reader, transform and
+ * writer threads if there are blocks for it, and anything else is
+ * transformed block by block on this thread.
+ *
+ * @param  os - output stream for the transformed data.
+ * @param  is - the input file.
+ * @param  job - the number of threads and of pipeline blocks to use.
+ * @return error value or 0 if no errors.
+ */
+template<size_t size, Leading leading, Trailing trailing>
+int Status<size, leading, trailing>::process(std::ostream &os, Input &is, const Job &job)
+{
+    if ((job.jobs > 1) && (is.isMapped()) && (is.getMapping().size() > minChunkSize))
+        return processParallel(os, is.getMapping(), job.jobs);
+
+    if ((job.buffers > 1) && ((!is.isRegular()) || (is.getSize() >= minPipelineSize)))
+        return runPipeline(is, os, job.buffers, [this](std::span<const char> block, Output &out) { process(block, out); });
+
+    Output out{os};
+
+    for (auto block{is.read()}; !block.empty(); block = is.read())
+    {
+        process(block, out);
+    }
+
+    out.flush();
+
+    if (is.isError())
+    {
+        std::cerr << "Error reading file " << is.getPath() << '\n';
+
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/*****************************************************************************
+ * @section Transform selection.
+ *
+ */
+
+template<size_t size, Leading leading, Trailing trailing>
+static int transform(std::ostream &os, Input &is, const Job &job)
+{
+    Status<size, leading, trailing> state{};
+
+    return state.process(os, is, job);
+}
+
+template<size_t size, Leading leading, Trailing trailing>
+static void transformMemory(std::span<const char> data, Output &out)
+{
+    Status<size, leading, trailing> state{};
+    state.process(data, out);
+    out.flush();
+}
+
+template<size_t size, Leading leading, Trailing trailing>
+static constexpr Transform specialise{transform<size, leading, trailing>, transformMemory<size, leading, trailing>};
+
+template<size_t size, Leading leading>
+static Transform selectTrailing(const Options &options)
+{
+    switch (options.trailing)
+    {
+    case Trailing::crlf:        return specialise<size, leading, Trailing::crlf>;
+    case Trailing::lf:          return specialise<size, leading, Trailing::lf>;
+    case Trailing::unchanged:   break;
+    }
+
+    return specialise<size, leading, Trailing::unchanged>;
+}
+
+template<size_t size>
+static Transform selectLeading(const Options &options)
+{
+    switch (options.leading)
+    {
+    case Leading::space:        return selectTrailing<size, Leading::space>(options);
+    case Leading::tab:          return selectTrailing<size, Leading::tab>(options);
+    case Leading::unchanged:    break;
+    }
+
+    return selectTrailing<size, Leading::unchanged>(options);
+}
+
+/**
+ * Select the Status specialised for the options given.
+ *
+ * @param  options - the options to transform with.
+ * @return the transform functions for the options.
+ */
+Transform selectTransform(const Options &options)
+{
+    switch (options.tabSize)
+    {
+    case 2: return selectLeading<2>(options);
+    case 8: return selectLeading<8>(options);
+    }
+
+    return selectLeading<4>(options);
+}
+
+} // namespace tfc
+
@@ -0,0 +1,60 @@
+/**
+ * @file    status.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the transform state machine.
+ */
+
+#if !defined _STATUS_H_INCLUDED_
+#define _STATUS_H_INCLUDED_
+
+#include <ostream>
+#include <span>
+
+#include "options.h"
+
+namespace tfc
+{
+
+class Input;
+class Output;
+
+
+/**
+ * @section Transform selection.
+ *
+ * The entry points of the Status specialised for a set of options, for a
+ * file and for data already in memory.
+ */
+
+struct Transform
+{
+    int (*stream)(std::ostream &os, Input &is, const Job &job);
+    void (*memory)(std::span<const char> data, Output &out);
+};
+
+extern Transform selectTransform(const Options &options);
+
+} // namespace tfc
+
+
+#endif //!defined _STATUS_H_INCLUDED_
+
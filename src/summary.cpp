@@ -26,300 +26,319 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <optional>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "tfc.h"
 #include "configuration.h"
-
+#include "state.h"
+#include "input.h"
+#include "batch.h"
+#include "cache.h"
+#include "watch.h"
 
 
 /**
- * @section Internal constants and variables.
+ * @section main code.
  *
  */
 
-class State
+//- The caches enabled by the user, if any.
+struct Caches
 {
-public:
-    int process(std::ostream &os, std::ifstream &is);
-
-private:
-    char event;
-    bool start{true};
-    bool space{};
-    bool tab{};
-    bool cr{};
-    bool lf{};
-    int lines{};
-    int neither{};
-    int spOnly{};
-    int tabOnly{};
-    int both{};
-    int malformed{};
-    int dosEOL{};
-    int unixEOL{};
-    int ansi{};
-    int utf8{};
-    int utf8Needed{};
-    int utf8Processed{};
-    int utf8Error{};
-    void processTab(void);
-    void processSpace(void);
-    void processLineFeed(void);
-    void processCarriageReturn(void);
-    void processAllOther(unsigned char event);
-    void display(std::ostream &os);
-    void displaySummary(std::ostream &os);
-    void displayDebug(std::ostream &os);
+    std::unique_ptr<Cache> file;
+    std::unique_ptr<ContentCache> contents;
 };
 
-static void streamValue(std::ostream &os, const std::string & label, int value)
+/**
+ * @return true if every page of the mapping is in the page cache.
+ */
+static bool isResident(std::span<const char> mapping)
 {
-    if (value == 0)
-    {
-        return;
-    }
-
-    os << "  ";
+    const size_t page{static_cast<size_t>(::sysconf(_SC_PAGESIZE))};
+    std::vector<unsigned char> pages((mapping.size() + page - 1) / page);
+    if (::mincore(const_cast<char *>(mapping.data()), mapping.size(), pages.data()) != 0)
+        return true;
 
-	std::string valStr{std::to_string(value)};
-    std::string padding(18 - label.length() - valStr.length(), ' ');
-    os << label << ":" << padding << valStr;
-
-    os << "\n";
+    return std::all_of(pages.begin(), pages.end(), [](unsigned char state) { return state & 1; });
 }
 
-void State::displaySummary(std::ostream &os)
+/**
+ * Summarise a mapped file as it is hashed, then cache the summary unless
+ * it is there already.
+ *
+ * @param  is - the mapped file.
+ * @param  job - the settings to summarise the file with.
+ * @param  os - output stream for the summary.
+ * @param  state - updated with the counts for the file.
+ * @param  contents - the content cache.
+ */
+static void summarizeHashing(tfc::Input &is, const Job &job, std::ostream &os, tfc::State &state, ContentCache &contents)
 {
-    os << Config::getInputFile().string() << '\n';
-    streamValue(os, "Total Lines", lines);
-
-    os << "Line beginning:\n";
-    streamValue(os, "Space only", spOnly);
-    streamValue(os, "Tab only", tabOnly);
-    streamValue(os, "Neither", neither);
-    streamValue(os, "Both", both);
-
-    os << "Line ending:\n";
-    streamValue(os, "Dos", dosEOL);
-    streamValue(os, "Unix", unixEOL);
-    streamValue(os, "Malformed", malformed);
-
-    if (ansi || utf8)
+    ContentHash hash{};
+    for (auto block{is.read()}; !block.empty(); block = is.read())
     {
-        os << "Character encoding:\n";
-        streamValue(os, "ANSI", ansi);
-        streamValue(os, "UTF-8", utf8);
+        hash.update(block);
+        state.process(block);
     }
+    state.display(os, is.getPath().string(), job.options.debug);
 
-    os << '\n';
+    const uint64_t options{job.options.getHash()};
+    const Cache::Counts counts{state.getSummary()};
+    Cache::Counts found{};
+    if (!contents.findCounts(hash.digest(), is.getSize(), options, found))
+        contents.insertCounts(hash.digest(), is.getSize(), options, counts);
 }
 
-void State::displayDebug(std::ostream &os)
-{
-    os << Config::getInputFile().string() << '\n';
-    os << lines;
-    os << " " << spOnly;
-    os << " " << tabOnly;
-    os << " " << neither;
-    os << " " << both;
-    os << " " << dosEOL;
-    os << " " << unixEOL;
-    os << " " << malformed;
-    os << '\n';
-}
-
-void State::display(std::ostream &os)
-{
-    if (Config::isDebug())
-        displayDebug(os);
-    else
-        displaySummary(os);
-}
-
-void State::processTab(void)
+/**
+ * Summarise a single file, or recall the summary from a cache. The file
+ * cache is tried first, as it does not need the file to be opened. The
+ * content cache needs the file to be hashed first, which is much quicker
+ * than summarising it while the file is in memory. A file that is not
+ * would be read from the disk twice on a miss, so it is summarised as it
+ * is hashed instead, although that is wasted on a hit. A file already
+ * loaded is hashed and summarised from memory.
+ *
+ * @param  file - path of the file.
+ * @param  loaded - the contents of the file, if already loaded.
+ * @param  job - the settings to summarise the file with.
+ * @param  os - output stream for the summary.
+ * @param  state - updated with the counts for the file.
+ * @param  caches - the caches of summaries enabled.
+ * @return error value or 0 if no errors.
+ */
+static int summarizeFile(const std::filesystem::path & file, Loader::Contents loaded, const Job &job, std::ostream &os, tfc::State &state, Caches &caches)
 {
-    if (start)
-        tab = true;
+    const uint64_t options{job.options.getHash()};
+    Cache::Counts counts{};
+    Cache::Key key{};
+    const bool cacheable{(caches.file) && (Cache::makeKey(file, options, key))};
+    if ((cacheable) && (caches.file->find(key, counts)))
+    {
+        state = tfc::State{counts};
+        state.display(os, file.string(), job.options.debug);
 
-    lf = false;
-    cr = false;
-}
+        return 0;
+    }
 
-void State::processSpace(void)
-{
-    if (start)
-        space = true;
+    std::optional<tfc::Input> is{};
+    if (!loaded)
+    {
+        const bool map{(job.mapping) || (caches.contents)};
+        is.emplace(file, job.blockSize, map ? tfc::Input::Mode::map : tfc::Input::Mode::automatic, job.uncached);
+        if (!is->is_open())
+        {
+            std::cerr << "Unable to open file " << file << '\n';
 
-    lf = false;
-    cr = false;
-}
+            return 1;
+        }
+    }
 
-void State::processLineFeed(void)
-{
-    if (cr)
-        ++dosEOL;
-    else
+    const auto data{loaded ? *loaded : is->getMapping()};
+    const bool hashed{(caches.contents) && ((loaded) || (is->isMapped()))};
+    if ((hashed) && (!loaded) && (!isResident(data)))
     {
-        ++unixEOL;
-        lf = true;
-    }
+        summarizeHashing(*is, job, os, state, *caches.contents);
+        if (cacheable)
+            caches.file->insert(key, state.getSummary());
 
-    ++lines;
+        return 0;
+    }
 
-    if (tab)
+    const uint64_t hash{hashed ? hashContents(data) : 0};
+    const size_t size{hashed ? data.size() : 0};
+    if ((hashed) && (caches.contents->findCounts(hash, size, options, counts)))
     {
-        if (space)
-            ++both;
-        else
-            ++tabOnly;
+        state = tfc::State{counts};
+        state.display(os, file.string(), job.options.debug);
     }
     else
     {
-        if (space)
-            ++spOnly;
+        if (loaded)
+        {
+            state.process(data);
+            state.display(os, file.string(), job.options.debug);
+        }
         else
-            ++neither;
+        {
+            const int ret{state.process(os, *is, job)};
+            if (ret)
+                return ret;
+        }
+
+        counts = state.getSummary();
+        if (hashed)
+            caches.contents->insertCounts(hash, size, options, counts);
     }
 
-    tab = false;
-    space = false;
-    start = true;
-    cr = false;
+    if (cacheable)
+        caches.file->insert(key, counts);
+
+    return 0;
 }
 
-void State::processCarriageReturn(void)
+/**
+ * @return true if the files are to be loaded through io_uring. A hit in
+ * the file cache needs no read at all, so files are not loaded ahead of
+ * their tasks when it is enabled.
+ */
+static bool isLoading(const Job &job, const Caches &caches)
 {
-    if (lf)
-    {
-        ++malformed;
-        --unixEOL;		// Was counted as unix, but shouldn't be.
-        cr = false;
-    }
-    else
-        cr = true;
-
-    lf = false;
+    return (job.uring) && (!caches.file);
 }
 
-static int numUtf8Bytes(unsigned char lead)
+/**
+ * Summarise every file given, followed by the total of them all.
+ *
+ * @param  job - the settings to summarise the files with.
+ * @param  os - output stream for the summaries.
+ * @param  caches - the caches of summaries enabled.
+ * @return error value or 0 if no errors.
+ */
+static int summarizeBatch(const Job &job, std::ostream &os, Caches &caches)
 {
-    if ((lead & 0x80) == 0x0)   return 1;
-    if ((lead & 0xE0) == 0xC0)  return 2;
-    if ((lead & 0xF0) == 0xE0)  return 3;
-    if ((lead & 0xF8) == 0xF0)  return 4;
+    tfc::State total{};
+    std::mutex mutex{};
+    Batch batch{os, job.jobs, [&](const std::filesystem::path & file, Loader::Contents loaded, std::ostream &report)
+    {
+        tfc::State state{};
+        const int ret{summarizeFile(file, loaded, job, report, state, caches)};
 
-    return 0;
-}
+        std::lock_guard lock{mutex};
+        total += state;
 
-static bool isUtf8ContinuationByte(unsigned char byte)
-{
-    return ((byte & 0xC0) == 0x80);
+        return ret;
+    }, isLoading(job, caches), job.uncached};
+
+    for (const auto & path : Config::getInputFiles())
+        batch.add(path);
+
+    if (Config::isListing())
+        batch.addList(Config::getListFile(), Config::getListSeparator());
+
+    const int ret{batch.finish()};
+    total.display(os, "Total of " + std::to_string(batch.getFiles()) + " files", job.options.debug);
+
+    return ret;
 }
 
-void State::processAllOther(unsigned char event)
+/**
+ * Summarise every file in the watched trees, then keep the summaries up to
+ * date, summarising only the files that change and displaying each of them
+ * followed by the new total. Runs until the trees can no longer be watched.
+ *
+ * @param  job - the settings to summarise the files with.
+ * @param  os - output stream for the summaries.
+ * @param  caches - the caches of summaries enabled.
+ * @return error value.
+ */
+static int summarizeWatch(const Job &job, std::ostream &os, Caches &caches)
 {
-    start = false;
-    lf = false;
-    cr = false;
+    Watch watch{Config::getInputFiles()};
+    if (!watch.is_open())
+    {
+        std::cerr << "Unable to watch for changes\n";
+
+        return 1;
+    }
 
-    if (event > 0x7F)
+    std::map<std::filesystem::path, tfc::State> results{};
+    std::mutex mutex{};
+    Batch batch{os, job.jobs, [&](const std::filesystem::path & file, Loader::Contents loaded, std::ostream &report)
     {
-        if (utf8Needed)
-        {
-            if (isUtf8ContinuationByte(event))
-            {
-                ++utf8Processed;
-                if (utf8Processed == utf8Needed)
-                {
-                    ++utf8;
-                    utf8Needed = 0;
-                    utf8Processed = 0;
-                }
+        tfc::State state{};
+        const int ret{summarizeFile(file, loaded, job, report, state, caches)};
 
+        std::lock_guard lock{mutex};
+        if (ret)
+            results.erase(file);
+        else
+            results[file] = state;
 
-            }
-            else
-            {
-                ansi += utf8Processed;
-                utf8Needed = 0;
-                utf8Processed = 0;
-            }
+        return ret;
+    }, isLoading(job, caches), job.uncached};
 
+    Watch::Changes changes{};
+    changes.rescan = true;
+    do
+    {
+        if (changes.rescan)
+        {
+            results.clear();
+            for (const auto & path : Config::getInputFiles())
+                batch.add(path);
         }
         else
         {
-            int length{numUtf8Bytes(event)};
-            if (length)
+            for (const auto & path : changes.removed)
             {
-                utf8Needed = length;
-                utf8Processed = 1;
-            }
-            else
-            {
-                ++ansi;
+                for (auto it{results.lower_bound(path)}; (it != results.end()) && (Watch::isWithin(it->first, path)); )
+                {
+                    os << it->first.string() << "\n  Removed\n\n";
+                    it = results.erase(it);
+                }
             }
+
+            for (const auto & file : changes.changed)
+                batch.add(file);
         }
 
-    }
-}
+        batch.finish();
 
+        tfc::State total{};
+        for (const auto & result : results)
+            total += result.second;
 
-int State::process(std::ostream &os, std::ifstream &is)
-{
-    for (is.get(event); !is.eof(); is.get(event))
-    {
-        switch (event)
-        {
-        case '\t':  processTab();               break;
-        case ' ':   processSpace();             break;
-    
-        case '\n':  processLineFeed();          break;
-        case '\r':  processCarriageReturn();    break;
-    
-        default:    processAllOther(event);
-        }
-    }
+        total.display(os, "Total of " + std::to_string(results.size()) + " files", job.options.debug);
+        os.flush();
 
-    display(os);
+        if (caches.file)
+            caches.file->flush();
+    } while (watch.wait(changes));
 
-    return 0;
-}
+    std::cerr << "Unable to watch for changes\n";
 
+    return 1;
+}
 
 /**
- * @section main code.
- *
- */
-
-/**
- * Process the user specified file.
+ * Process the user specified files.
  *
  * @return error value or 0 if no errors.
  */
 int processSummary(void)
 {
-    State state{};
-    const auto & inputFile{Config::getInputFile()};
+    std::ofstream file{};
+    if (!Config::getOutputFile().empty())
+        file.open(Config::getOutputFile(), std::ios::out);
 
-    std::ifstream is{inputFile, std::ios::binary};
-    if (is.is_open()) 
-    {
-        if (std::ofstream os{Config::getOutputFile(), std::ios::out})
-        {
-            state.process(os, is);
-        }
-        else
-        {
-            state.process(std::cout, is);
-        }
-    }
-    else
-    {
-        std::cerr << "Unable to open file " << inputFile << '\n';
+    std::ostream &os{file.is_open() ? file : std::cout};
 
-        return 1;
-    }
+    Caches caches{};
+    if (Config::isCaching())
+        caches.file = std::make_unique<Cache>(Config::getCacheFile());
 
-    return 0;
-}
+    if (Config::isContentCaching())
+        caches.contents = std::make_unique<ContentCache>(Config::getCacheDirectory());
+
+    const Job job{Config::getJob()};
+    if (Config::isWatching())
+        return summarizeWatch(job, os, caches);
 
+    tfc::State state{};
+    const int ret{Config::isBatch() ?
+        summarizeBatch(job, os, caches) :
+        summarizeFile(Config::getInputFile(), {}, job, os, state, caches)};
+
+    if (caches.file)
+        caches.file->flush();
+
+    return ret;
+}
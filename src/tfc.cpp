@@ -62,6 +62,16 @@ int main(int argc, char *argv[])
     }
 
 //- If all is well, generate the output.
+    if (Config::isServing())
+    {
+        return processDaemon();
+    }
+
+    if (Config::isClient())
+    {
+        return processClient();
+    }
+
     if (Config::isChangeRequested())
     {
         return processTransform();
@@ -33,6 +33,8 @@
  */
 extern int processTransform(void);
 extern int processSummary(void);
+extern int processDaemon(void);
+extern int processClient(void);
 
 #endif //!defined _TFC_H_INCLUDED_
 
@@ -26,373 +26,254 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <optional>
+
+#include <unistd.h>
 
 #include "tfc.h"
 #include "configuration.h"
+#include "status.h"
+#include "input.h"
+#include "output.h"
+#include "replace.h"
+#include "pipe.h"
+#include "batch.h"
+#include "cache.h"
+#include "watch.h"
 
 
-class Status
-{
-public:
-    Status(void) :
-        size{Config::getTabSize()},
-        ignoreHead{!Config::isLeadingSet()},
-        ignoreTail{!Config::isTrailingSet()},
-        space{Config::isSpace()},
-        tab{Config::isTab()},
-        newline{Config::isDos() ? std::string("\r\n") : std::string("\n") },
-        state{State::start},
-        nlState{NLState::start},
-        event{},
-        column{}
-        {}
-    int process(std::ostream &os, std::ifstream &is);
-
-private:
-    enum class State { start, beginning, middle, end };
-    enum class NLState { start, CR_rec, LF_rec, other };
-
-    const size_t size;
-    const bool ignoreHead;
-    const bool ignoreTail;
-    const bool space;
-    const bool tab;
-    const std::string newline;
-
-    State state;
-    NLState nlState;
-    char event;
-    int column;
-    
-    bool isNewLine(void) const {    return ((event == '\n') || (event == '\r')); }
-    std::string padding(void);
-
-    std::string processCharStart(void);
-    std::string processCharBeginning(void);
-    std::string processCharEnd(void);
-    std::string processChar(void);
-
-    std::string processNewlineStart(void);
-    std::string processNewlineCR(void);
-    std::string processNewlineLF(void);
-    std::string processNewlineOther(void);
-    std::string processNewline(void);
-};
-
-/**
- * @section Utility functions.
+/*****************************************************************************
+ * @section main code.
  *
  */
 
-std::string Status::padding(void)
-{
-    if (tab)
-    {
-        const int tabs = column / size;
-        const int spaces = column - (tabs * size);
-
-        return std::string(tabs, '\t') + std::string(spaces, ' ');
-    }
-
-    if (space)
-    {
-        return std::string(column, ' ');
-    }
-
-    return std::string{};
-}
-
-
 /**
- * @section whitespace handler.
+ * Replace a file with its transformed version, if that is any different.
+ * A file already loaded is transformed from memory, otherwise it is mapped.
  *
+ * @param  file - path of the file.
+ * @param  loaded - the contents of the file, if already loaded.
+ * @param  job - the settings to transform the file with.
+ * @param  rewritten - updated to show whether the file was rewritten.
+ * @param  bytes - updated with the number of bytes written, if rewritten.
+ * @param  contents - the cache of files known to need no change, if enabled.
+ * @return error value or 0 if no errors.
  */
-std::string Status::processCharStart(void)
-{
-    switch (event)
-    {
-    case ' ':
-        state = State::beginning;
-        ++column;
-        break;
-
-    case '\t':
-        state = State::beginning;
-        column = ((column / size) + 1) * size;
-        break;
-
-    default:
-        state = State::middle;
-        return std::string{event};
-    }
-
-    return "";
-}
-
-std::string Status::processCharBeginning(void)
+static int replaceFile(const std::filesystem::path & file, Loader::Contents loaded, const Job &job, bool &rewritten, size_t &bytes, ContentCache *contents)
 {
-    switch (event)
+//- The original contents are mapped to compare the output against.
+    std::optional<tfc::Input> is{};
+    if (!loaded)
     {
-    case ' ':
-        ++column;
-        break;
-
-    case '\t':
-        column = ((column / size) + 1) * size;
-        break;
-
-    default:
-        state = State::middle;
-        return padding() + std::string{event};
-    }
-
-    return "";
-}
-
-std::string Status::processCharEnd(void)
-{
-    switch (event)
-    {
-    case ' ':
-        state = State::beginning;
-        column = 1;
-        break;
-
-    case '\t':
-        state = State::beginning;
-        column = size;
-        break;
-
-    default:
-        state = State::middle;
-        return std::string{event};
-    }
-
-    return "";
-}
-
-std::string Status::processChar(void)
-{
-    if (ignoreHead)
-    {
-        if (isNewLine())
+        is.emplace(file, job.blockSize, tfc::Input::Mode::map, job.uncached);
+        if (!is->is_open())
         {
-            state = State::end;
-            return std::string{};
-        }
+            std::cerr << "Unable to open file " << file << '\n';
 
-        return std::string{event};
+            return 1;
+        }
     }
 
-    if (isNewLine())
+//- Hashing the mapping is much cheaper than transforming it, but a file
+//- that needs transforming and does not fit in memory is read twice.
+    const uint64_t options{job.options.getHash()};
+    const auto original{loaded ? *loaded : is->getMapping()};
+    const bool hashed{(contents) && ((loaded) || (is->isMapped()))};
+    const uint64_t hash{hashed ? hashContents(original) : 0};
+    if ((hashed) && (contents->isUnchanged(hash, original.size(), options)))
+        return 0;
+
+    LazyReplacement replacement{file, original};
+    std::ostream os{&replacement};
+    const auto transform{tfc::selectTransform(job.options)};
+    int ret{};
+    if (loaded)
     {
-        std::string ret{};
-        if (state == State::beginning)
-            ret = padding();
-
-        state = State::end;
-
-        return ret;
+        tfc::Output out{os};
+        transform.memory(original, out);
     }
+    else
+        ret = transform.stream(os, *is, job);
 
-    std::string result{};
-    switch (state)
-    {
-    case State::start:
-        result = processCharStart();
-        if (!result.empty())
-        {
-            return result;
-        }
-    break;
-
-    case State::beginning:
-        result = processCharBeginning();
-        if (!result.empty())
-        {
-            return result;
-        }
-    break;
-
-    case State::middle:
-        return std::string{event};
-    break;
+    if (!ret)
+        ret = replacement.commit(job.sync);
 
-    case State::end:
-        result = processCharEnd();
-        if (!result.empty())
-        {
-            return result;
-        }
-    break;
+    rewritten = replacement.isRewritten();
+    bytes = replacement.getBytesWritten();
 
-    }
+    if ((hashed) && (!ret) && (!rewritten))
+        contents->insertUnchanged(hash, original.size(), options);
 
-    return std::string{};
+    return ret;
 }
 
-
 /**
- * @section newline handler.
+ * Replace every file given that needs it, reporting each file and the
+ * total. When watching, carry on replacing the files that change, with a
+ * total for each set of changes, until the trees can no longer be watched.
  *
+ * @param  job - the settings to transform the files with.
+ * @param  contents - the cache of files known to need no change, if enabled.
+ * @return error value or 0 if no errors.
  */
-
-std::string Status::processNewlineStart(void)
+static int replaceBatch(const Job &job, ContentCache *contents)
 {
-    switch (event)
+//- Start watching first so that no change made during the first pass is missed.
+    std::unique_ptr<Watch> watch{};
+    if (Config::isWatching())
     {
-    case '\r':  nlState = NLState::CR_rec;  return newline;
-    case '\n':  nlState = NLState::LF_rec;  return newline;
+        watch = std::make_unique<Watch>(Config::getInputFiles());
+        if (!watch->is_open())
+        {
+            std::cerr << "Unable to watch for changes\n";
 
-    default:    nlState = NLState::other;
+            return 1;
+        }
     }
 
-    return "";
-}
-
-std::string Status::processNewlineCR(void)
-{
-    switch (event)
+    size_t files{};
+    size_t written{};
+    std::map<std::filesystem::path, Cache::Key> replaced{};
+    std::mutex mutex{};
+    Batch batch{std::cout, job.jobs, [&](const std::filesystem::path & file, Loader::Contents loaded, std::ostream &report)
     {
-    case '\r':  return newline;
-    case '\n':  nlState = NLState::other;   break;
-
-    default:    nlState = NLState::other;
-    }
+        bool rewritten{};
+        size_t bytes{};
+        const int ret{replaceFile(file, loaded, job, rewritten, bytes, contents)};
+        if (rewritten)
+            report << file.string() << ": rewritten, " << bytes << " bytes\n";
+        else if (ret == 0)
+            report << file.string() << ": unchanged\n";
+
+        Cache::Key key{};
+        const bool known{(watch) && (rewritten) && (Cache::makeKey(file, 0, key))};
+
+        std::lock_guard lock{mutex};
+        files += rewritten ? 1 : 0;
+        written += bytes;
+        if (known)
+            replaced[file] = key;
 
-    return "";
-}
+        return ret;
+    }, job.uring, job.uncached};
 
-std::string Status::processNewlineLF(void)
-{
-    switch (event)
+//- A file that is just as it was replaced is only reporting our own change.
+    auto isReplaced = [&](const std::filesystem::path & file)
     {
-    case '\r':  nlState = NLState::other;   break;
-    case '\n':  return newline;
+        std::lock_guard lock{mutex};
+        const auto found{replaced.find(file)};
+        if (found == replaced.end())
+            return false;
 
-    default:    nlState = NLState::other;
-    }
+        Cache::Key key{};
+        const bool same{(Cache::makeKey(file, 0, key)) && (std::memcmp(&key, &found->second, sizeof key) == 0)};
+        replaced.erase(found);
 
-    return "";
-}
+        return same;
+    };
 
-std::string Status::processNewlineOther(void)
-{
-    switch (event)
+    auto displayTotal = [&](size_t count)
     {
-    case '\r':  nlState = NLState::CR_rec;  return newline;
-    case '\n':  nlState = NLState::LF_rec;  return newline;
+        std::cout << files << " of " << count << " files rewritten, " << written << " bytes written.\n";
+        std::cout.flush();
+        files = 0;
+        written = 0;
+    };
 
-    default:    nlState = NLState::other;
-    }
+    for (const auto & path : Config::getInputFiles())
+        batch.add(path);
 
-    return "";
-}
+    if (Config::isListing())
+        batch.addList(Config::getListFile(), Config::getListSeparator());
 
-std::string Status::processNewline(void)
-{
-    if ((ignoreTail) && (isNewLine()))
-        return std::string{event};
+    const int ret{batch.finish()};
+    displayTotal(batch.getFiles());
 
-    std::string result{};
-    switch (nlState)
-    {
-    case NLState::start:
-        result = processNewlineStart();
-        if (!result.empty())
-        {
-            return result;
-        }
-    break;
+    if (!watch)
+        return ret;
 
-    case NLState::CR_rec:
-        result = processNewlineCR();
-        if (!result.empty())
+    Watch::Changes changes{};
+    while (watch->wait(changes))
+    {
+        const size_t before{batch.getFiles()};
+        if (changes.rescan)
         {
-            return result;
+            for (const auto & path : Config::getInputFiles())
+                batch.add(path);
         }
-    break;
-
-    case NLState::LF_rec:
-        result = processNewlineLF();
-        if (!result.empty())
+        else
         {
-            return result;
+            for (const auto & file : changes.changed)
+                if (!isReplaced(file))
+                    batch.add(file);
         }
-    break;
 
-    case NLState::other:
-        result = processNewlineOther();
-        if (!result.empty())
-        {
-            return result;
-        }
+        batch.finish();
+        if (batch.getFiles() != before)
+            displayTotal(batch.getFiles() - before);
     }
 
-    return std::string{};
-}
+    std::cerr << "Unable to watch for changes\n";
 
-
-int Status::process(std::ostream &os, std::ifstream &is)
-{
-    for (is.get(event); !is.eof(); is.get(event))
-    {
-        os << processChar() << processNewline();
-    }
-
-    return 0;
+    return 1;
 }
 
-
-/*****************************************************************************
- * @section main code.
- *
- */
-
 /**
- * Process the user specified file.
+ * Process the user specified files.
  *
  * @return error value or 0 if no errors.
  */
 int processTransform(void)
 {
-    Status state{};
+    const Job job{Config::getJob()};
     const auto & inputFile{Config::getInputFile()};
 
-    std::ifstream is{inputFile, std::ios::binary};
+    if (Config::isReplacing())
+    {
+        std::unique_ptr<ContentCache> contents{};
+        if (Config::isContentCaching())
+            contents = std::make_unique<ContentCache>(Config::getCacheDirectory());
+
+        if (Config::isBatch())
+            return replaceBatch(job, contents.get());
+
+        bool rewritten{};
+        size_t bytes{};
+        const auto ret{replaceFile(inputFile, {}, job, rewritten, bytes, contents.get())};
+        if (ret == 0)
+            std::cout << (rewritten ? 1 : 0) << " of 1 files rewritten, " << bytes << " bytes written.\n";
+
+        return ret;
+    }
+
+    const auto transform{tfc::selectTransform(job.options)};
+    tfc::Input is{inputFile, job.blockSize, job.mapping ? tfc::Input::Mode::map : tfc::Input::Mode::automatic, job.uncached};
     if (is.is_open()) 
     {
-        if (Config::isReplacing())
+        if (std::ofstream os{Config::getOutputFile(), std::ios::binary})
         {
-            auto tempFile{std::filesystem::temp_directory_path()};
-            tempFile /= inputFile.filename();  // Temporary file path.
-            if (std::ofstream os{tempFile, std::ios::binary})
-            {
-                state.process(os, is);
-                os.close();
-                is.close();
-
-                const auto copyOptions = std::filesystem::copy_options::overwrite_existing;
-                if (!std::filesystem::copy_file(tempFile, inputFile, copyOptions))   // Overwrite.
-                {
-                    std::cerr << "Failed to copy file " << tempFile << " to " << inputFile << '\n';
-                }
-                std::filesystem::remove(tempFile);   // Clean up.
-            }
-            else
+            return transform.stream(os, is, job);
+        }
+        else
+        {
+            tfc::growPipe(STDOUT_FILENO, job.blockSize);
+            tfc::DescriptorBuffer buffer{STDOUT_FILENO};
+            std::ostream out{&buffer};
+            const int ret{transform.stream(out, is, job)};
+            if ((!ret) && (!out))
             {
-                std::cerr << "Failed to open file " << tempFile << '\n';
+                std::cerr << "Error writing output\n";
 
                 return 1;
             }
-        }
-        else if (std::ofstream os{Config::getOutputFile(), std::ios::binary})
-        {
-            state.process(os, is);
-        }
-        else
-        {
-            state.process(std::cout, is);
+
+            return ret;
         }
     }
     else
@@ -404,4 +285,3 @@ int processTransform(void)
 
     return 0;
 }
-
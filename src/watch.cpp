@@ -0,0 +1,284 @@
+/**
+ * @file    watch.cpp
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Implementation of the watching of directory trees for changed files.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+
+
+/**
+ * @section Internal constants and variables.
+ *
+ */
+
+//- How long the trees must be quiet before the changes are handed over, and
+//- the longest the changes are held back by a steady stream of events.
+static constexpr std::chrono::milliseconds settleTime{100};
+static constexpr std::chrono::milliseconds maxDelay{1000};
+
+static constexpr uint32_t events{IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR};
+
+
+/**
+ * @section Directory tree watching implementation.
+ *
+ */
+
+/**
+ * Start watching every directory in the given trees.
+ *
+ * @param  roots - the directories at the top of the trees.
+ */
+Watch::Watch(const std::vector<std::filesystem::path> & roots) :
+    fd{::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}, directories{}
+{
+    if (fd < 0)
+        return;
+
+    for (const auto & root : roots)
+        watch(root, nullptr);
+}
+
+Watch::~Watch(void)
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+/**
+ * @return true if the path is the directory or is inside it.
+ */
+bool Watch::isWithin(const std::filesystem::path & path, const std::filesystem::path & directory)
+{
+    const auto relative{path.lexically_relative(directory)};
+
+    return (!relative.empty()) && (*relative.begin() != "..");
+}
+
+/**
+ * Watch a directory and its subdirectories.
+ *
+ * @param  directory - to watch.
+ * @param  files - updated with the files found, if not null.
+ */
+void Watch::watch(const std::filesystem::path & directory, std::set<std::filesystem::path> *files)
+{
+    const int wd{::inotify_add_watch(fd, directory.c_str(), events)};
+    if (wd < 0)
+    {
+        std::cerr << "Unable to watch directory " << directory << '\n';
+
+        return;
+    }
+
+    directories[wd] = directory;
+
+//- The directory is read after the watch is added so that no file created
+//- in the meantime is missed.
+    std::error_code ec{};
+    for (std::filesystem::directory_iterator it{directory, ec}, end{}; (!ec) && (it != end); it.increment(ec))
+    {
+        const auto & entry{it->path()};
+        if ((entry.filename().string().starts_with('.')) || (std::filesystem::is_symlink(entry, ec)))
+            continue;
+
+        if (std::filesystem::is_directory(entry, ec))
+            watch(entry, files);
+        else
+        if ((files) && (std::filesystem::is_regular_file(entry, ec)))
+            files->insert(entry);
+    }
+}
+
+/**
+ * Stop watching a directory that has gone, and its subdirectories.
+ *
+ * @param  directory - no longer to be watched.
+ */
+void Watch::forget(const std::filesystem::path & directory)
+{
+    for (auto it{directories.begin()}; it != directories.end(); )
+    {
+        if (isWithin(it->second, directory))
+        {
+            ::inotify_rm_watch(fd, it->first);
+            it = directories.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+/**
+ * Record the effect of an event on the files being watched.
+ *
+ * @param  event - the event read from inotify.
+ * @param  changes - updated with the files changed or removed.
+ */
+void Watch::handle(const inotify_event &event, Changes &changes)
+{
+    if (event.mask & IN_Q_OVERFLOW)
+    {
+        changes.rescan = true;
+
+        return;
+    }
+
+    const auto found{directories.find(event.wd)};
+    if (found == directories.end())
+        return;
+
+    if (event.mask & IN_IGNORED)
+    {
+        directories.erase(found);
+
+        return;
+    }
+
+    if ((!event.len) || (event.name[0] == '.'))
+        return;
+
+    const auto path{found->second / event.name};
+    if (event.mask & IN_ISDIR)
+    {
+        if (event.mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            watch(path, &changes.changed);
+        }
+        else
+        if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            forget(path);
+            changes.removed.insert(path);
+        }
+    }
+    else
+    if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        std::error_code ec{};
+        if (std::filesystem::is_symlink(path, ec))
+            return;
+
+        changes.changed.insert(path);
+        changes.removed.erase(path);
+    }
+    else
+    if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+        changes.changed.erase(path);
+        changes.removed.insert(path);
+    }
+}
+
+/**
+ * Read the events waiting.
+ *
+ * @param  changes - updated with the files changed or removed.
+ * @return false if the events could not be read.
+ */
+bool Watch::read(Changes &changes)
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    const ssize_t length{::read(fd, buffer, sizeof buffer)};
+    if (length < 0)
+        return (errno == EINTR) || (errno == EAGAIN);
+
+    for (const char *next{buffer}; next < buffer + length; )
+    {
+        const auto *event{reinterpret_cast<const inotify_event *>(next)};
+        next += sizeof(inotify_event) + event->len;
+        handle(*event, changes);
+    }
+
+    return true;
+}
+
+/**
+ * Wait for files to change, then collect changes until the trees are quiet.
+ * Files that are no longer regular files by then are reported as removed.
+ *
+ * @param  changes - updated with the files changed or removed.
+ * @return false if the trees can no longer be watched.
+ */
+bool Watch::wait(Changes &changes)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto isQuiet = [&]() { return (changes.changed.empty()) && (changes.removed.empty()) && (!changes.rescan); };
+
+    changes = {};
+    pollfd ready{fd, POLLIN, 0};
+    Clock::time_point deadline{};
+    for (;;)
+    {
+        int timeout{-1};
+        if (!isQuiet())
+        {
+            const auto remaining{std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now())};
+            if (remaining.count() <= 0)
+                break;
+
+            timeout = static_cast<int>(std::min(remaining, std::chrono::milliseconds{settleTime}).count());
+        }
+
+        const int count{::poll(&ready, 1, timeout)};
+        if ((count < 0) && (errno != EINTR))
+            return false;
+
+        if (count == 0)
+            break;
+
+        const bool quiet{isQuiet()};
+        if ((count > 0) && (!read(changes)))
+            return false;
+
+        if ((quiet) && (!isQuiet()))
+            deadline = Clock::now() + maxDelay;
+    }
+
+    std::error_code ec{};
+    for (auto it{changes.changed.begin()}; it != changes.changed.end(); )
+    {
+        if (std::filesystem::is_regular_file(*it, ec))
+        {
+            ++it;
+        }
+        else
+        {
+            changes.removed.insert(*it);
+            it = changes.changed.erase(it);
+        }
+    }
+
+    return true;
+}
+
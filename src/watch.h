@@ -0,0 +1,82 @@
+/**
+ * @file    watch.h
+ * @author  Phil Lockett <phillockett65@gmail.com>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * https://www.gnu.org/copyleft/gpl.html
+ *
+ * @section DESCRIPTION
+ *
+ * 'tfc' is a command-line utility Text File Checker.
+ *
+ * Interface to the watching of directory trees for changed files.
+ */
+
+#if !defined _WATCH_H_INCLUDED_
+#define _WATCH_H_INCLUDED_
+
+#include <filesystem>
+#include <vector>
+#include <set>
+#include <unordered_map>
+
+struct inotify_event;
+
+
+/**
+ * @section Directory tree watching.
+ *
+ * Every directory in the trees is watched with inotify, skipping hidden
+ * entries and symbolic links as a batch does. Changes are collected until
+ * the trees have been quiet for a moment, so a burst of saves, or a
+ * checkout, is handled as a single set of changes. A directory
+ * created while watching is watched in turn and the files already in it
+ * are reported as changed.
+ */
+
+class Watch
+{
+public:
+    struct Changes
+    {
+        std::set<std::filesystem::path> changed;
+        std::set<std::filesystem::path> removed;
+        bool rescan{};
+    };
+
+    explicit Watch(const std::vector<std::filesystem::path> & roots);
+    ~Watch(void);
+
+//- Delete the copy constructor and assignement operator.
+    Watch(const Watch &) = delete;
+    void operator=(const Watch &) = delete;
+
+    bool is_open(void) const { return fd >= 0; }
+    bool wait(Changes &changes);
+
+    static bool isWithin(const std::filesystem::path & path, const std::filesystem::path & directory);
+
+private:
+    int fd;
+    std::unordered_map<int, std::filesystem::path> directories;
+
+    void watch(const std::filesystem::path & directory, std::set<std::filesystem::path> *files);
+    void forget(const std::filesystem::path & directory);
+    void handle(const inotify_event &event, Changes &changes);
+    bool read(Changes &changes);
+};
+
+
+#endif //!defined _WATCH_H_INCLUDED_
+